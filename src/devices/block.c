@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A block device. */
 struct block
@@ -113,6 +114,60 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR lie within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", count=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
+/* Callback for transfer(): wakes up the waiting thread. */
+static void
+wake_up (void *done)
+{
+  sema_up (done);
+}
+
+/* Moves the CNT sectors, at most BLOCK_REQUEST_MAX, starting at
+   SECTOR between BLOCK and BUFFER, reading into BUFFER if WRITE
+   is false and writing from it if WRITE is true, and waits for
+   the transfer to finish.  Does not update statistics. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffer, bool write)
+{
+  uint8_t *p = buffer;
+  size_t i;
+
+  ASSERT (cnt <= BLOCK_REQUEST_MAX);
+
+  if (block->ops->submit != NULL)
+    {
+      struct block_request r;
+      struct semaphore done;
+
+      sema_init (&done, 0);
+      r.cnt = cnt;
+      r.buffer = buffer;
+      r.write = write;
+      r.callback = wake_up;
+      r.aux = &done;
+      block->ops->submit (block->aux, sector, &r);
+      sema_down (&done);
+    }
+  else if (write)
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -121,7 +176,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
+  transfer (block, sector, 1, buffer, false);
   block->read_cnt++;
 }
 
@@ -135,10 +190,93 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
+  transfer (block, sector, 1, (void *) buffer, true);
   block->write_cnt++;
 }
 
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it move up to BLOCK_REQUEST_MAX
+   of them with a single device command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  uint8_t *p = buffer;
+
+  check_sectors (block, sector, cnt);
+  block->read_cnt += cnt;
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_REQUEST_MAX ? cnt : BLOCK_REQUEST_MAX;
+      transfer (block, sector, n, p, false);
+      sector += n;
+      p += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  Drivers that support it move up to BLOCK_REQUEST_MAX
+   of the sectors with a single device command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  uint8_t *p = (uint8_t *) buffer;
+
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  block->write_cnt += cnt;
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_REQUEST_MAX ? cnt : BLOCK_REQUEST_MAX;
+      transfer (block, sector, n, p, true);
+      sector += n;
+      p += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Starts request R on the R->cnt sectors of BLOCK beginning at
+   SECTOR and returns without waiting for it to finish.  R->cnt
+   must be between 1 and BLOCK_REQUEST_MAX.  When the transfer is
+   done, R->callback is called with R->aux, possibly from an
+   interrupt handler, so it must not sleep.  R must stay in
+   existence until then.
+   Drivers may reorder and combine pending requests, so the
+   order in which overlapping requests complete is unspecified.
+   A driver without support for queuing carries out R before
+   returning. */
+void
+block_submit (struct block *block, block_sector_t sector,
+              struct block_request *r)
+{
+  ASSERT (r->cnt > 0 && r->cnt <= BLOCK_REQUEST_MAX);
+  check_sectors (block, sector, r->cnt);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, sector, r);
+  else
+    {
+      transfer (block, sector, r->cnt, r->buffer, r->write);
+      r->callback (r->aux);
+    }
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
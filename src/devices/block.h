@@ -2,7 +2,9 @@
 #define DEVICES_BLOCK_H
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +55,39 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+
+/* Most sectors in one request. */
+#define BLOCK_REQUEST_MAX 128
+
+/* Called when a request finishes. */
+typedef void block_callback (void *aux);
+
+/* A request submitted with block_submit(). */
+struct block_request
+  {
+    /* Set by the submitter. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write BUFFER, or read into it? */
+    block_callback *callback;   /* Called when done. */
+    void *aux;                  /* Passed to CALLBACK. */
+
+    /* Owned by the driver while the request is pending. */
+    block_sector_t sector;      /* First sector on the device. */
+    void *device;               /* Driver's device. */
+    struct list_elem elem;      /* Element in the driver's queue. */
+  };
+
+void block_submit (struct block *, block_sector_t, struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,6 +97,12 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Starts a request on the sectors beginning at the given one
+       and returns without waiting for it, as block_submit().
+       Optional, but a driver that provides it is never asked to
+       READ or WRITE, which may then be null. */
+    void (*submit) (void *aux, block_sector_t, struct block_request *);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -9,6 +9,7 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +31,26 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, from the controller's PCI
+   configuration. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERROR 0x02       /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt raised (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +66,33 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Largest number of sectors moved by a single command.  The
+   Sector Count register allows 256. */
+#define IDE_MAX_SECTORS BLOCK_REQUEST_MAX
+
+/* If false (default), use DMA where the hardware supports it.
+   If true, always use PIO.
+   Controlled by kernel command-line option "-no-dma". */
+bool ide_dma_disabled;
+
+/* A Physical Region Descriptor, one piece of the memory that a
+   bus master DMA transfer reads or writes.  Regions may not
+   cross a 64 kB boundary.  A SIZE of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes. */
+    uint16_t flags;             /* PRD_EOT for the last entry. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT 16              /* Entries in a PRD table. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +101,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple_cnt;           /* Sectors per READ/WRITE MULTIPLE
+                                   interrupt, or 0 if unsupported. */
+    bool dma;                   /* Use bus master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -66,13 +113,28 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, or 0. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Request queue.  See "Request queue" below. */
+    struct list queue;          /* Pending requests, sorted by key. */
+    struct list active;         /* Requests in the command in progress. */
+    uint32_t head;              /* Key just past the last command. */
+    bool cmd_write;             /* Is the active command a write? */
+    bool cmd_dma;               /* Does it use DMA? */
+    size_t cmd_left;            /* PIO: sectors still to transfer. */
+    struct list_elem *cmd_req;  /* PIO: request being transferred. */
+    size_t cmd_ofs;             /* PIO: sectors of it transferred. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
+
+    /* PRD table for DMA transfers.  Aligned so that it does not
+       cross a 64 kB boundary, as the controller requires. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (sizeof (struct prd)
+                                                      * PRD_CNT)));
   };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -84,14 +146,17 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static bool set_multiple_mode (struct ata_disk *, int cnt);
+static uint16_t find_bus_master (void);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool wait_for_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,6 +166,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = ide_dma_disabled ? 0 : find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +189,12 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->queue);
+      list_init (&c->active);
+      c->head = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +205,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple_cnt = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -262,6 +333,7 @@ identify_ata_device (struct ata_disk *d)
   struct channel *c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
   block_sector_t capacity;
+  int multiple_max;
   char *model, *serial;
   char extra_info[128];
   struct block *block;
@@ -279,7 +351,7 @@ identify_ata_device (struct ata_disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity.
      Read model name and serial number. */
@@ -303,12 +375,97 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Move as many sectors per interrupt as the disk allows, or
+     all of them at once if the disk and controller can do DMA. */
+  multiple_max = *(uint16_t *) &id[47 * 2] & 0xff;
+  if (multiple_max > 1 && set_multiple_mode (d, multiple_max))
+    d->multiple_cnt = multiple_max;
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & (1 << 8)) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D, asking it to
+   move CNT sectors per interrupt in READ MULTIPLE and WRITE
+   MULTIPLE commands.  Returns true if the disk accepted. */
+static bool
+set_multiple_mode (struct ata_disk *d, int cnt)
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  return (inb (reg_alt_status (c)) & STA_ERR) == 0;
+}
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* PCI Command Register bits. */
+#define PCI_CMD_IO 0x0001               /* Respond to I/O accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004       /* May act as a bus master. */
+
+/* Returns the 32-bit register at offset REG in the configuration
+   space of function FUNC of device DEV on PCI bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG in the
+   configuration space of function FUNC of device DEV on PCI bus
+   0. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that drives the two
+   legacy channels and can act as a bus master, as the PIIX in a
+   standard PC (or emulator) does.  If there is one, enables bus
+   mastering on it and returns the base I/O port of its bus master
+   registers.  Otherwise, returns 0. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        /* Class, subclass and programming interface. */
+        uint32_t class = pci_read_config (dev, func, 0x08) >> 8;
+        uint32_t bar4, command;
+
+        /* Mass storage/IDE, both channels in compatibility mode,
+           bus master capable. */
+        if ((class >> 8) != 0x0101 || (class & 0x85) != 0x80)
+          continue;
+        bar4 = pci_read_config (dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* The upper half of the register is the status, whose bits
+           are cleared by writing 1s, so write back 0s there. */
+        command = pci_read_config (dev, func, 0x04) & 0xffff;
+        pci_write_config (dev, func, 0x04,
+                          command | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +494,314 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Request queue.
+
+   Each channel keeps the requests for its disks in a queue
+   sorted by key, which is the device number followed by the
+   sector number.  Requests are served in C-LOOK order: upward
+   from the key where the last command ended, then back to the
+   lowest key.  A command also takes the requests that continue
+   the first one on consecutive sectors in the same direction, up
+   to IDE_MAX_SECTORS in all.
+
+   The interrupt handler moves PIO data, finishes commands and
+   starts the next one, so the queue and the command state are
+   protected by disabling interrupts. */
+
+/* Returns request R's key. */
+static uint32_t
+request_key (const struct block_request *r)
+{
+  const struct ata_disk *d = r->device;
+  return ((uint32_t) d->dev_no << 28) | r->sector;
+}
+
+/* Returns true if request A's key is less than request B's. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return request_key (a) < request_key (b);
+}
+
+/* Returns the number of PRD entries needed for the SIZE bytes at
+   BUFFER, which must be in kernel memory. */
+static size_t
+prd_count (const void *buffer, size_t size)
+{
+  uintptr_t addr = vtop (buffer);
+  return ((addr + size - 1) >> 16) - (addr >> 16) + 1;
+}
+
+/* Fills channel C's PRD table to describe the buffers of the
+   requests in its active command, in order. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+build_prdt (struct channel *c)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct prd *prd = c->prdt;
+  struct list_elem *e;
+
+  for (e = list_begin (&c->active); e != list_end (&c->active);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uintptr_t addr = vtop (r->buffer);
+      size_t size = r->cnt * BLOCK_SECTOR_SIZE;
+
+      for (; size > 0; prd++)
+        {
+          size_t chunk = 0x10000 - (addr & 0xffff);
+          if (chunk > size)
+            chunk = size;
+
+          ASSERT (prd < c->prdt + PRD_CNT);
+          prd->addr = addr;
+          prd->size = chunk & 0xffff;
+          prd->flags = 0;
+          addr += chunk;
+          size -= chunk;
+        }
+    }
+  prd[-1].flags = PRD_EOT;
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Moves the next block of channel C's active PIO command between
+   disk D and the requests' buffers: one sector, or up to
+   D->multiple_cnt with READ/WRITE MULTIPLE.  Panics if the disk
+   is not ready for it. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+pio_block (struct channel *c, struct ata_disk *d)
+{
+  size_t block_cnt = d->multiple_cnt > 1 ? d->multiple_cnt : 1;
+  size_t n = c->cmd_left < block_cnt ? c->cmd_left : block_cnt;
+
+  ASSERT (n > 0);
+
+  c->cmd_left -= n;
+  while (n-- > 0)
+    {
+      struct block_request *r = list_entry (c->cmd_req,
+                                            struct block_request, elem);
+      uint8_t *sector = (uint8_t *) r->buffer + c->cmd_ofs * BLOCK_SECTOR_SIZE;
+
+      if (!wait_for_drq (d))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+               c->cmd_write ? "write" : "read", r->sector + c->cmd_ofs);
+      if (c->cmd_write)
+        output_sectors (c, sector, 1);
+      else
+        input_sectors (c, sector, 1);
+
+      if (++c->cmd_ofs == r->cnt)
+        {
+          c->cmd_req = list_next (c->cmd_req);
+          c->cmd_ofs = 0;
+        }
+    }
+}
+
+/* If channel C is idle and has requests waiting, takes the next
+   one in C-LOOK order off its queue, along with the ones that
+   continue it, and starts a command for them.  Interrupts must
+   be off. */
+static void
+start_command (struct channel *c)
+{
+  struct block_request *first;
+  struct list_elem *e;
+  struct ata_disk *d;
+  block_sector_t end;
+  size_t cnt, prd_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&c->active) || list_empty (&c->queue))
+    return;
+
+  /* Find the first request at or past the head, wrapping around
+     to the lowest key if there is none. */
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    if (request_key (list_entry (e, struct block_request, elem)) >= c->head)
+      break;
+  if (e == list_end (&c->queue))
+    e = list_begin (&c->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  d = first->device;
+  c->cmd_write = first->write;
+  c->cmd_dma = d->dma && is_kernel_vaddr (first->buffer);
+
+  /* Move it and the requests that continue it to the active
+     command.  The queue is sorted, so they come right after. */
+  end = first->sector;
+  cnt = prd_cnt = 0;
+  while (e != list_end (&c->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+
+      if (r->device != d || r->write != c->cmd_write || r->sector != end
+          || cnt + r->cnt > IDE_MAX_SECTORS)
+        break;
+      if (c->cmd_dma)
+        {
+          if (!is_kernel_vaddr (r->buffer))
+            break;
+          prd_cnt += prd_count (r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+          if (prd_cnt > PRD_CNT)
+            break;
+        }
+
+      e = list_remove (e);
+      list_push_back (&c->active, &r->elem);
+      end += r->cnt;
+      cnt += r->cnt;
+    }
+  c->head = ((uint32_t) d->dev_no << 28) | end;
+
+  select_sector (d, first->sector, cnt);
+  if (c->cmd_dma)
+    {
+      uint8_t direction = c->cmd_write ? 0 : BM_CMD_READ;
+
+      build_prdt (c);
+      outl (reg_bm_prdt (c), vtop (c->prdt));
+      outb (reg_bm_command (c), direction);
+      outb (reg_bm_status (c),
+            inb (reg_bm_status (c)) | BM_STA_ERROR | BM_STA_INTR);
+      outb (reg_command (c), c->cmd_write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      outb (reg_bm_command (c), direction | BM_CMD_START);
+    }
+  else
+    {
+      bool multiple = d->multiple_cnt > 1;
+
+      c->cmd_left = cnt;
+      c->cmd_req = list_begin (&c->active);
+      c->cmd_ofs = 0;
+      if (c->cmd_write)
+        {
+          /* A write wants its first block right away.  The disk
+             interrupts when it has taken each block. */
+          outb (reg_command (c), (multiple ? CMD_WRITE_MULTIPLE
+                                  : CMD_WRITE_SECTOR_RETRY));
+          pio_block (c, d);
+        }
+      else
+        outb (reg_command (c), (multiple ? CMD_READ_MULTIPLE
+                                : CMD_READ_SECTOR_RETRY));
+    }
+}
+
+/* Handles an interrupt on channel C, whose disk has status
+   STATUS, for the active command: moves the next block of PIO
+   data or, if the command is done, starts the next one and
+   calls back the submitters of the requests it served. */
+static void
+command_interrupt (struct channel *c, uint8_t status)
+{
+  struct block_request *first = list_entry (list_front (&c->active),
+                                            struct block_request, elem);
+  struct ata_disk *d = first->device;
+  struct list done;
+
+  if (c->cmd_dma)
+    {
+      uint8_t bm_status;
+
+      /* Stop the engine.  Writing back the status clears its
+         error and interrupt bits. */
+      outb (reg_bm_command (c), c->cmd_write ? 0 : BM_CMD_READ);
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), bm_status);
+      if ((bm_status & BM_STA_ERROR) != 0
+          || (status & (STA_ERR | STA_DF)) != 0)
+        {
+          /* Put the requests back and redo them with PIO. */
+          printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+                  d->name, c->cmd_write ? "write" : "read", first->sector);
+          d->dma = false;
+          while (!list_empty (&c->active))
+            list_insert_ordered (&c->queue, list_pop_front (&c->active),
+                                 request_less, NULL);
+          c->head = request_key (first);
+          start_command (c);
+          return;
+        }
+    }
+  else if (c->cmd_write)
+    {
+      /* The disk has taken a block.  Send the next one, if any. */
+      if (c->cmd_left > 0)
+        {
+          pio_block (c, d);
+          return;
+        }
+      if ((status & (STA_ERR | STA_DF)) != 0)
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, first->sector);
+    }
+  else
+    {
+      /* A block is ready. */
+      pio_block (c, d);
+      if (c->cmd_left > 0)
+        return;
+    }
+
+  /* Get the disk busy again before running the callbacks. */
+  list_init (&done);
+  list_splice (list_end (&done), list_begin (&c->active),
+               list_end (&c->active));
+  start_command (c);
+  while (!list_empty (&done))
+    {
+      struct block_request *r = list_entry (list_pop_front (&done),
+                                            struct block_request, elem);
+      r->callback (r->aux);
+    }
+}
+
+/* Queues request R on the sectors of disk D beginning at SEC_NO,
+   and starts it if D's channel is idle. */
+static void
+ide_submit (void *d_, block_sector_t sec_no, struct block_request *r)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  enum intr_level old_level;
+
+  r->sector = sec_no;
+  r->device = d;
+
+  old_level = intr_disable ();
+  list_insert_ordered (&c->queue, &r->elem, request_less, NULL);
+  start_command (c);
+  intr_set_level (old_level);
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,
+    NULL,
+    ide_submit
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, the number of sectors to transfer, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= 256);
+  ASSERT (sec_no < (1UL << 28) && cnt <= (1UL << 28) - sec_no);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);            /* 256 is written as 0. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -414,22 +822,23 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *buffer, size_t cnt) 
 {
-  insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  insw (reg_data (c), buffer, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from BUFFER to channel C's data register in
+   PIO mode.  BUFFER must contain CNT * BLOCK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *buffer, size_t cnt) 
 {
-  outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), buffer, cnt * BLOCK_SECTOR_SIZE / 2);
 }
-
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -446,7 +855,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +888,26 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Busy-waits up to a second for disk D to clear BSY, then
+   returns true if it is asserting DRQ without ERR.  Unlike
+   wait_while_busy(), does not sleep, so it may be called with
+   interrupts off. */
+static bool
+wait_for_drq (const struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if ((status & STA_BSY) == 0)
+        return (status & (STA_DRQ | STA_ERR)) == STA_DRQ;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +918,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -511,9 +940,12 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (!list_empty (&c->active))
+          command_interrupt (c, inb (reg_status (c)));  /* Acknowledge. */
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
+            c->expecting_interrupt = false;
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
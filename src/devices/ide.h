@@ -1,6 +1,12 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* If true, IDE transfers never use DMA.
+   Controlled by the kernel command-line option "-no-dma". */
+extern bool ide_dma_disabled;
+
 void ide_init (void);
 
 #endif /* devices/ide.h */
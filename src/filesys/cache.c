@@ -0,0 +1,390 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Ticks between two passes of the write-behind thread. */
+#define WRITE_BEHIND_INTERVAL (5 * TIMER_FREQ)
+
+/* Maximum number of pending read-ahead requests.  Requests
+   issued while the queue is full are dropped. */
+#define READ_AHEAD_MAX 16
+
+/* A cached sector.
+
+   SECTOR, VALID, ACCESSED and PIN_CNT are protected by
+   cache_lock.  DATA and DIRTY are protected by the entry's own
+   LOCK, which may only be held while the entry is pinned, so
+   that an entry with a zero PIN_CNT is never locked and may be
+   recycled. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Cached sector. */
+    bool valid;                         /* Does SECTOR mean anything? */
+    bool accessed;                      /* Recently used, for clock. */
+    int pin_cnt;                        /* Users of this entry. */
+
+    struct lock lock;                   /* Protects DATA and DIRTY. */
+    bool dirty;                         /* Must be written back? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;          /* Protects cache metadata. */
+static struct condition cache_unpinned; /* Signaled when a pin drops. */
+static size_t clock_hand;               /* Next eviction candidate. */
+
+/* A read-ahead request: CNT sectors starting at SECTOR. */
+struct read_ahead
+  {
+    block_sector_t sector;
+    size_t cnt;
+  };
+
+/* Read-ahead queue, a ring of requests. */
+static struct read_ahead read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready;
+
+static thread_func write_behind_daemon NO_RETURN;
+static thread_func read_ahead_daemon NO_RETURN;
+
+/* Initializes the buffer cache and starts its helper threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].valid = false;
+      cache[i].pin_cnt = 0;
+      cache[i].dirty = false;
+      lock_init (&cache[i].lock);
+    }
+
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_ready);
+
+  thread_create ("cache-flush", PRI_DEFAULT, write_behind_daemon, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Returns the valid entry caching SECTOR, or a null pointer if
+   there is none.  Must be called with cache_lock held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an unpinned entry to recycle using the clock
+   algorithm.  Returns a null pointer if every entry is pinned.
+   Must be called with cache_lock held. */
+static struct cache_entry *
+pick_victim (void)
+{
+  size_t i;
+
+  /* Two sweeps suffice: the first clears accessed bits, so the
+     second is guaranteed to stop at any unpinned entry. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0)
+        continue;
+      if (!e->valid)
+        return e;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Drops one pin on E.  Must be called with cache_lock held. */
+static void
+unpin (struct cache_entry *e)
+{
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+}
+
+/* Returns the entry for SECTOR, pinned and with its lock held.
+   If SECTOR is not yet cached, an entry is recycled for it and,
+   if LOAD is true, filled from disk.  If LOAD is false the
+   caller must overwrite the whole sector.  Release the entry
+   with cache_put(). */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      e = pick_victim ();
+      if (e == NULL)
+        {
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      if (e->valid && e->dirty)
+        {
+          /* Write the victim back while it still maps its old
+             sector, so that nobody can read a stale copy from
+             disk in the meantime, then look again. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          if (e->dirty)
+            {
+              block_write (fs_device, e->sector, e->data);
+              e->dirty = false;
+            }
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          unpin (e);
+          continue;
+        }
+
+      /* E is clean and unpinned, so nobody holds its lock. */
+      e->sector = sector;
+      e->valid = true;
+      e->accessed = true;
+      e->pin_cnt = 1;
+      lock_acquire (&e->lock);
+      lock_release (&cache_lock);
+
+      if (load)
+        block_read (fs_device, sector, e->data);
+      return e;
+    }
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  unpin (e);
+  lock_release (&cache_lock);
+}
+
+/* Reads sector SECTOR through the cache into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at SECTOR_OFS within sector SECTOR
+   through the cache into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer,
+               int sector_ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + sector_ofs, size);
+  cache_put (e);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into the cached
+   copy of sector SECTOR.  The data reaches the disk later, when
+   the sector is evicted or flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER at SECTOR_OFS within the cached
+   copy of sector SECTOR.  The rest of the sector is read from
+   disk first if it is not yet cached. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                int sector_ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + sector_ofs, buffer, size);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Asks the read-ahead thread to bring the CNT sectors starting
+   at SECTOR, at most CACHE_READ_AHEAD, into the cache.  Returns
+   immediately. */
+void
+cache_readahead (block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0 && cnt <= CACHE_READ_AHEAD);
+
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      struct read_ahead *ra = &read_ahead_queue[(read_ahead_head
+                                                 + read_ahead_cnt++)
+                                                % READ_AHEAD_MAX];
+      ra->sector = sector;
+      ra->cnt = cnt;
+      cond_signal (&read_ahead_ready, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Writes every dirty cached sector back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+        }
+      cache_put (e);
+    }
+}
+
+/* Periodically writes dirty sectors back to disk, so that a
+   crash loses at most WRITE_BEHIND_INTERVAL ticks of writes. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Brings the CNT sectors starting at SECTOR, at most
+   CACHE_READ_AHEAD, into the cache.  Each run of them that is
+   not cached yet is read from disk with a single request. */
+static void
+prefetch (block_sector_t sector, size_t cnt)
+{
+  static uint8_t buffer[CACHE_READ_AHEAD * BLOCK_SECTOR_SIZE];
+  struct cache_entry *run[CACHE_READ_AHEAD];
+  size_t run_cnt, i;
+
+  ASSERT (cnt <= CACHE_READ_AHEAD);
+
+  while (cnt > 0)
+    {
+      /* Claim clean entries for as many uncached sectors as
+         possible.  Anyone else who wants them waits on their
+         locks until they are filled. */
+      lock_acquire (&cache_lock);
+      for (run_cnt = 0; run_cnt < cnt; run_cnt++)
+        {
+          struct cache_entry *e;
+
+          if (lookup (sector + run_cnt) != NULL)
+            break;
+          e = pick_victim ();
+          if (e == NULL || (e->valid && e->dirty))
+            break;
+          e->sector = sector + run_cnt;
+          e->valid = true;
+          e->accessed = true;
+          e->pin_cnt = 1;
+          lock_acquire (&e->lock);
+          run[run_cnt] = e;
+        }
+      lock_release (&cache_lock);
+
+      if (run_cnt == 0)
+        {
+          /* SECTOR is cached already, or getting an entry for it
+             means writing back a dirty one first. */
+          cache_put (cache_get (sector, true));
+          run_cnt = 1;
+        }
+      else
+        {
+          block_read_multiple (fs_device, sector, run_cnt, buffer);
+          for (i = 0; i < run_cnt; i++)
+            {
+              memcpy (run[i]->data, buffer + i * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE);
+              cache_put (run[i]);
+            }
+        }
+      sector += run_cnt;
+      cnt -= run_cnt;
+    }
+}
+
+/* Services cache_readahead() requests. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct read_ahead ra;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &read_ahead_lock);
+      ra = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      prefetch (ra.sector, ra.cnt);
+    }
+}
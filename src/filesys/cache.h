@@ -0,0 +1,20 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+/* Number of sectors held by the buffer cache. */
+#define CACHE_SIZE 64
+
+/* Most sectors brought in by one read-ahead request. */
+#define CACHE_READ_AHEAD 8
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, int sector_ofs, int size);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, int sector_ofs, int size);
+void cache_readahead (block_sector_t, size_t cnt);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
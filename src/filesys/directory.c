@@ -1,10 +1,12 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -21,12 +23,161 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* In-memory index of a directory's entries.
+
+   Built from the on-disk entries the first time the directory is
+   searched after it is opened, then kept up to date by dir_add()
+   and dir_remove(), so that finding a name or a free slot does
+   not scan the directory.  The on-disk format is unchanged.
+   Owned by the directory's inode, which destroys it on last
+   close, and protected by the inode's lock. */
+struct dir_index
+  {
+    struct hash entries;                /* In-use entries, by name. */
+    struct list free_slots;             /* Unused slots. */
+    off_t end;                          /* Offset just past the last slot. */
+  };
+
+/* An in-use directory entry in a dir_index. */
+struct index_entry
+  {
+    struct hash_elem elem;              /* Element in entries. */
+    off_t ofs;                          /* Byte offset of slot. */
+    struct dir_entry e;                 /* Copy of on-disk entry. */
+  };
+
+/* An unused slot in a dir_index. */
+struct free_slot
+  {
+    struct list_elem elem;              /* Element in free_slots. */
+    off_t ofs;                          /* Byte offset of slot. */
+  };
+
+/* Number of entries read at once while building an index. */
+#define INDEX_READ_CNT 16
+
+/* Path lookup cache ("dentry cache").
+
+   Remembers, for recently looked-up names, the sector of the
+   inode that a name in a given directory refers to, so that
+   resolving a path again does not read the directories along it.
+   The cache is direct-mapped: each (directory, name) pair has a
+   single slot, and a new entry simply replaces the old one.
+
+   Entries are added and invalidated only with the directory's
+   inode lock held, so a cached name always matches the
+   directory's contents.  Nothing is cached for a removed
+   directory, since its sector may be reused. */
+#define DCACHE_SIZE 256
+
+struct dcache_entry
+  {
+    bool in_use;                        /* Holds a valid entry? */
+    block_sector_t dir_sector;          /* Directory's inode sector. */
+    block_sector_t inode_sector;        /* Inode that NAME refers to. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+static struct dcache_entry dcache[DCACHE_SIZE];
+static struct lock dcache_lock;         /* Protects dcache. */
+
+/* Returns the dentry cache slot for NAME in the directory whose
+   inode is in DIR_SECTOR. */
+static struct dcache_entry *
+dcache_slot (block_sector_t dir_sector, const char *name)
+{
+  return &dcache[(hash_string (name) ^ hash_int (dir_sector)) % DCACHE_SIZE];
+}
+
+/* Returns true if slot D caches NAME in the directory whose
+   inode is in DIR_SECTOR. */
+static bool
+dcache_match (const struct dcache_entry *d, block_sector_t dir_sector,
+              const char *name)
+{
+  return d->in_use && d->dir_sector == dir_sector && !strcmp (d->name, name);
+}
+
+/* Records that NAME in DIR refers to the inode in INODE_SECTOR.
+   The caller must hold DIR's inode lock. */
+static void
+dcache_insert (const struct dir *dir, const char *name,
+               block_sector_t inode_sector)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct dcache_entry *d = dcache_slot (dir_sector, name);
+
+  lock_acquire (&dcache_lock);
+  d->in_use = true;
+  d->dir_sector = dir_sector;
+  d->inode_sector = inode_sector;
+  strlcpy (d->name, name, sizeof d->name);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets any cached entry for NAME in DIR.
+   The caller must hold DIR's inode lock. */
+static void
+dcache_invalidate (const struct dir *dir, const char *name)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct dcache_entry *d = dcache_slot (dir_sector, name);
+
+  lock_acquire (&dcache_lock);
+  if (dcache_match (d, dir_sector, name))
+    d->in_use = false;
+  lock_release (&dcache_lock);
+}
+
+/* Opens the inode that NAME in DIR refers to, if that is cached,
+   and stores it in *INODE.  Returns true if successful, false if
+   NAME is not cached or the inode cannot be opened.  Opens the
+   inode before releasing dcache_lock, so that the entry cannot
+   be invalidated, and the inode's sector freed and reused, in
+   between. */
+static bool
+dcache_lookup (const struct dir *dir, const char *name,
+               struct inode **inode)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct dcache_entry *d = dcache_slot (dir_sector, name);
+
+  *inode = NULL;
+  lock_acquire (&dcache_lock);
+  if (dcache_match (d, dir_sector, name))
+    *inode = inode_open (d->inode_sector);
+  lock_release (&dcache_lock);
+  return *inode != NULL;
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  lock_init (&dcache_lock);
+}
+
+/* Creates a directory with space for ENTRY_CNT entries, not
+   counting "." and "..", in the given SECTOR.  PARENT_SECTOR is
+   the sector of the directory that contains it; for the root
+   directory, it is the root itself.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt,
+            block_sector_t parent_sector)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, (entry_cnt + 2) * sizeof (struct dir_entry),
+                     true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent_sector));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,21 +234,167 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns a hash value for index entry E. */
+static unsigned
+index_entry_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct index_entry *e = hash_entry (e_, struct index_entry, elem);
+  return hash_string (e->e.name);
+}
+
+/* Returns true if index entry A's name precedes B's. */
+static bool
+index_entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct index_entry *a = hash_entry (a_, struct index_entry, elem);
+  const struct index_entry *b = hash_entry (b_, struct index_entry, elem);
+  return strcmp (a->e.name, b->e.name) < 0;
+}
+
+/* Frees index entry E. */
+static void
+index_entry_free (struct hash_elem *e_, void *aux UNUSED)
+{
+  free (hash_entry (e_, struct index_entry, elem));
+}
+
+/* Destroys INDEX, if it is nonnull. */
+void
+dir_index_destroy (struct dir_index *index)
+{
+  if (index == NULL)
+    return;
+  hash_destroy (&index->entries, index_entry_free);
+  while (!list_empty (&index->free_slots))
+    free (list_entry (list_pop_front (&index->free_slots),
+                      struct free_slot, elem));
+  free (index);
+}
+
+/* Records in INDEX that entry E is in the slot at OFS.  Returns
+   true if successful, false if out of memory. */
+static bool
+index_add (struct dir_index *index, const struct dir_entry *e, off_t ofs)
+{
+  if (e->in_use)
+    {
+      struct index_entry *ie = malloc (sizeof *ie);
+      if (ie == NULL)
+        return false;
+      ie->ofs = ofs;
+      ie->e = *e;
+      hash_insert (&index->entries, &ie->elem);
+    }
+  else
+    {
+      struct free_slot *fs = malloc (sizeof *fs);
+      if (fs == NULL)
+        return false;
+      fs->ofs = ofs;
+      list_push_back (&index->free_slots, &fs->elem);
+    }
+  return true;
+}
+
+/* Returns INDEX's entry for NAME, or a null pointer if there is
+   none. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  strlcpy (key.e.name, name, sizeof key.e.name);
+  e = hash_find (&index->entries, &key.elem);
+  return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Returns DIR's index, building it from the directory's contents
+   if it has none yet.  Returns a null pointer if out of memory,
+   in which case the caller must fall back to scanning the
+   directory.  The caller must hold DIR's inode lock. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  struct dir_entry buf[INDEX_READ_CNT];
+  off_t bytes_read;
+
+  if (index != NULL)
+    return index;
+
+  index = malloc (sizeof *index);
+  if (index == NULL
+      || !hash_init (&index->entries, index_entry_hash, index_entry_less,
+                     NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  list_init (&index->free_slots);
+
+  /* Read many entries at a time, rather than one per call. */
+  index->end = 0;
+  while ((bytes_read = inode_read_at (dir->inode, buf, sizeof buf,
+                                      index->end)) >= (off_t) sizeof *buf)
+    {
+      size_t i;
+
+      for (i = 0; i < bytes_read / sizeof *buf; i++)
+        {
+          if (!index_add (index, &buf[i], index->end))
+            {
+              dir_index_destroy (index);
+              return NULL;
+            }
+          index->end += sizeof *buf;
+        }
+    }
+
+  inode_set_dir_index (dir->inode, index);
+  return index;
+}
+
+/* Discards DIR's index, if any, after running out of memory while
+   updating it.  It is rebuilt by the next get_index(). */
+static void
+drop_index (const struct dir *dir)
+{
+  dir_index_destroy (inode_get_dir_index (dir->inode));
+  inode_set_dir_index (dir->inode, NULL);
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's inode lock. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_find (index, name);
+      if (ie == NULL)
+        return false;
+      if (ep != NULL)
+        *ep = ie->e;
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -111,6 +408,32 @@ lookup (const struct dir *dir, const char *name,
   return false;
 }
 
+/* Returns true if DIR contains no entries other than "." and
+   "..".  The caller must hold DIR's inode lock. */
+static bool
+is_empty (const struct dir *dir)
+{
+  struct dir_index *index = get_index (dir);
+  struct dir_entry e;
+  off_t ofs;
+
+  if (index != NULL)
+    {
+      size_t cnt = hash_size (&index->entries);
+      if (index_find (index, ".") != NULL)
+        cnt--;
+      if (index_find (index, "..") != NULL)
+        cnt--;
+      return cnt == 0;
+    }
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      return false;
+  return true;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -124,10 +447,19 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (dcache_lookup (dir, name, inode))
+    return true;
+
+  inode_lock (dir->inode);
   if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+    {
+      *inode = inode_open (e.inode_sector);
+      if (!inode_is_removed (dir->inode))
+        dcache_insert (dir, name, e.inode_sector);
+    }
   else
     *inode = NULL;
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,11 +468,12 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,21 +485,32 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock (dir->inode);
+
+  /* Check that DIR is still there and NAME is not in use. */
+  if (inode_is_removed (dir->inode) || lookup (dir, name, NULL, NULL))
     goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+     current end-of-file. */
+  index = get_index (dir);
+  if (index == NULL)
+    {
+      /* inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get a
+         short read due to something intermittent such as low
+         memory. */
+      for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+           ofs += sizeof e) 
+        if (!e.in_use)
+          break;
+    }
+  else if (!list_empty (&index->free_slots))
+    ofs = list_entry (list_front (&index->free_slots),
+                      struct free_slot, elem)->ofs;
+  else
+    ofs = index->end;
 
   /* Write slot. */
   e.in_use = true;
@@ -174,24 +518,45 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* Update the index. */
+  if (success && index != NULL)
+    {
+      if (ofs == index->end)
+        index->end += sizeof e;
+      else
+        free (list_entry (list_pop_front (&index->free_slots),
+                          struct free_slot, elem));
+      if (!index_add (index, &e, ofs))
+        drop_index (dir);
+    }
+
  done:
+  inode_unlock (dir->inode);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs
+   only if there is no file with the given NAME, if NAME is "."
+   or "..", or if it is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool victim_locked = false;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
+  inode_lock (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -201,36 +566,92 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove empty directories.  Hold the victim's lock until
+     it is marked removed, so that nothing can be added to it in
+     the meantime.  Locking parent before child cannot deadlock,
+     since a directory never contains its own ancestors. */
+  if (inode_is_dir (inode))
+    {
+      struct dir victim = { inode, 0 };
+
+      inode_lock (inode);
+      victim_locked = true;
+      if (!is_empty (&victim))
+        goto done;
+
+      /* Its inode sector may be reused once it is gone. */
+      dcache_invalidate (&victim, ".");
+      dcache_invalidate (&victim, "..");
+    }
+
   /* Erase directory entry. */
+  dcache_invalidate (dir, name);
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
+  /* Move the entry to the index's free slots. */
+  index = inode_get_dir_index (dir->inode);
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_find (index, name);
+      hash_delete (&index->entries, &ie->elem);
+      free (ie);
+      if (!index_add (index, &e, ofs))
+        drop_index (dir);
+    }
+
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  if (victim_locked)
+    inode_unlock (inode);
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/* Reads the next directory entry in DIR, other than "." and "..",
+   and stores the name in NAME.  Returns true if successful, false
+   if the directory contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  inode_lock (dir->inode);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock (dir->inode);
+  return found;
+}
+
+/* Sets the position of the next entry that dir_readdir() reads
+   from DIR to POS, a value previously returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position of the next entry that dir_readdir()
+   reads from DIR. */
+off_t
+dir_tell (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
 }
@@ -1,23 +1,48 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
+#include <stdio.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef USERPROG
+#include "userprog/exec_cache.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers held in the inode itself, and in one
+   indirect block. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR ((size_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Largest file, in sectors, that the index can map. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a multi-level index: the first
+   DIRECT_CNT are listed in DIRECT, the next PTRS_PER_SECTOR in
+   the block at INDIRECT, and the rest through the two-level tree
+   rooted at DOUBLY_INDIRECT.  A pointer of 0 means "not
+   allocated"; sector 0 holds the free map and is never data.
+   Every sector below LENGTH is allocated. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect index block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect index block. */
+    unsigned is_dir;                    /* Nonzero for a directory. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,14 +53,243 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* Returns entry IDX of index block TABLE. */
+static block_sector_t
+index_get (block_sector_t table, size_t idx)
+{
+  block_sector_t sector;
+
+  cache_read_at (table, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Allocates a sector, fills it with zeros, and stores it in
+   *SECTORP, unless *SECTORP already names one.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (*sectorp != 0)
+    return true;
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros);
+  return true;
+}
+
+/* Like allocate_zeroed(), but for entry IDX of index block TABLE,
+   which is written back if it changes.  Stores the entry's
+   sector in *SECTORP. */
+static bool
+index_allocate (block_sector_t table, size_t idx, block_sector_t *sectorp)
+{
+  *sectorp = index_get (table, idx);
+  if (*sectorp != 0)
+    return true;
+  if (!allocate_zeroed (sectorp))
+    return false;
+  cache_write_at (table, sectorp, idx * sizeof *sectorp, sizeof *sectorp);
+  return true;
+}
+
+/* Returns the data sector at index IDX within the file described
+   by DISK_INODE, which must already be allocated. */
+static block_sector_t
+index_to_sector (const struct inode_disk *disk_inode, size_t idx)
+{
+  if (idx < DIRECT_CNT)
+    return disk_inode->direct[idx];
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return index_get (disk_inode->indirect, idx);
+  idx -= PTRS_PER_SECTOR;
+
+  return index_get (index_get (disk_inode->doubly_indirect,
+                               idx / PTRS_PER_SECTOR),
+                    idx % PTRS_PER_SECTOR);
+}
+
+/* Makes sure the data sector at index IDX within DISK_INODE, and
+   any index blocks leading to it, are allocated.  Returns false
+   if the disk is full.  Anything allocated before a failure stays
+   recorded in the index, for the caller to release. */
+static bool
+allocate_index (struct inode_disk *disk_inode, size_t idx)
+{
+  block_sector_t level1, sector;
+
+  if (idx < DIRECT_CNT)
+    return allocate_zeroed (&disk_inode->direct[idx]);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return (allocate_zeroed (&disk_inode->indirect)
+            && index_allocate (disk_inode->indirect, idx, &sector));
+  idx -= PTRS_PER_SECTOR;
+
+  return (allocate_zeroed (&disk_inode->doubly_indirect)
+          && index_allocate (disk_inode->doubly_indirect,
+                             idx / PTRS_PER_SECTOR, &level1)
+          && index_allocate (level1, idx % PTRS_PER_SECTOR, &sector));
+}
+
+/* Releases the data sector at index IDX within DISK_INODE, if it
+   is allocated, and clears its entry.  Index blocks stay. */
+static void
+release_index (struct inode_disk *disk_inode, size_t idx)
+{
+  block_sector_t table, sector;
+
+  if (idx < DIRECT_CNT)
+    {
+      if (disk_inode->direct[idx] != 0)
+        free_map_release (disk_inode->direct[idx], 1);
+      disk_inode->direct[idx] = 0;
+      return;
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    table = disk_inode->indirect;
+  else
+    {
+      idx -= PTRS_PER_SECTOR;
+      table = (disk_inode->doubly_indirect != 0
+               ? index_get (disk_inode->doubly_indirect,
+                            idx / PTRS_PER_SECTOR)
+               : 0);
+      idx %= PTRS_PER_SECTOR;
+    }
+  if (table == 0)
+    return;
+
+  sector = index_get (table, idx);
+  if (sector != 0)
+    {
+      free_map_release (sector, 1);
+      sector = 0;
+      cache_write_at (table, &sector, idx * sizeof sector, sizeof sector);
+    }
+}
+
+/* Releases index block *TABLEP and clears *TABLEP if none of its
+   entries is in use.  Returns true if it was released. */
+static bool
+prune_table (block_sector_t *tablep)
+{
+  size_t i;
+
+  if (*tablep == 0)
+    return false;
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    if (index_get (*tablep, i) != 0)
+      return false;
+  free_map_release (*tablep, 1);
+  *tablep = 0;
+  return true;
+}
+
+/* Undoes a partial extend(): releases the data sectors of
+   DISK_INODE at indexes FIRST up to END, which are the last ones
+   it maps, and the index blocks that no longer map anything. */
+static void
+shrink (struct inode_disk *disk_inode, size_t first, size_t end)
+{
+  const size_t base = DIRECT_CNT + PTRS_PER_SECTOR;
+  size_t i;
+
+  for (i = first; i < end; i++)
+    release_index (disk_inode, i);
+
+  if (end > base && disk_inode->doubly_indirect != 0)
+    {
+      size_t j = first > base ? (first - base) / PTRS_PER_SECTOR : 0;
+
+      for (; j <= (end - 1 - base) / PTRS_PER_SECTOR; j++)
+        {
+          block_sector_t level1 = index_get (disk_inode->doubly_indirect, j);
+          if (prune_table (&level1))
+            cache_write_at (disk_inode->doubly_indirect, &level1,
+                            j * sizeof level1, sizeof level1);
+        }
+      prune_table (&disk_inode->doubly_indirect);
+    }
+  if (end > DIRECT_CNT)
+    prune_table (&disk_inode->indirect);
+}
+
+/* Grows DISK_INODE to LENGTH bytes, allocating zeroed sectors for
+   the new part.  Returns false, leaving DISK_INODE as it was, if
+   LENGTH is beyond what the index can map or the disk fills up.
+   The caller is responsible for writing DISK_INODE back. */
+static bool
+extend (struct inode_disk *disk_inode, off_t length)
+{
+  size_t old_sectors = bytes_to_sectors (disk_inode->length);
+  size_t sectors = bytes_to_sectors (length);
+  size_t i;
+
+  if (sectors > MAX_SECTORS)
+    return false;
+  for (i = old_sectors; i < sectors; i++)
+    if (!allocate_index (disk_inode, i))
+      {
+        /* Index I may have got index blocks but no data sector. */
+        shrink (disk_inode, old_sectors, i + 1);
+        return false;
+      }
+  if (length > disk_inode->length)
+    disk_inode->length = length;
+  return true;
+}
+
+/* Releases index block TABLE, and if LEVEL > 0 the blocks it
+   points to, recursively.  A null TABLE is ignored. */
+static void
+release_tree (block_sector_t table, int level)
+{
+  size_t i;
+
+  if (table == 0)
+    return;
+  if (level > 0)
+    for (i = 0; i < PTRS_PER_SECTOR; i++)
+      release_tree (index_get (table, i), level - 1);
+  free_map_release (table, 1);
+}
+
+/* Releases every data and index sector of DISK_INODE. */
+static void
+deallocate (const struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree (disk_inode->direct[i], 0);
+  release_tree (disk_inode->indirect, 1);
+  release_tree (disk_inode->doubly_indirect, 2);
+}
+
+/* In-memory inode.
+   HASH_ELEM, OPEN_CNT, REMOVED and LOADED are protected by
+   open_inodes_lock.
+   DENY_WRITE_CNT and DATA are protected by RWLOCK, which readers
+   of the inode's contents hold shared and writers exclusive. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loaded;                        /* DATA read in yet? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Guards contents. */
+    struct lock lock;                   /* See inode_lock(). */
+    struct dir_index *dir_index;        /* See inode_get_dir_index(). */
+    bool exec_cached;                   /* See inode_set_exec_cached(). */
     struct inode_disk data;             /* Inode content. */
   };
 
@@ -48,29 +302,54 @@ byte_to_sector (const struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return index_to_sector (&inode->data, pos / BLOCK_SECTOR_SIZE);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+/* Largest number of inodes ever open at once. */
+static size_t open_inodes_peak;
+
+/* Returns a hash value for inode I. */
+static unsigned
+inode_hash (const struct hash_elem *i_, void *aux UNUSED)
+{
+  const struct inode *i = hash_entry (i_, struct inode, hash_elem);
+  return hash_int (i->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, hash_elem);
+  const struct inode *b = hash_entry (b_, struct inode, hash_elem);
+  return a->sector < b->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true, an
+   ordinary file otherwise.  The data sectors need not be
+   contiguous.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -84,22 +363,16 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
+      disk_inode->length = 0;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      if (extend (disk_inode, length)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          cache_write (sector, disk_inode);
           success = true; 
         } 
+      else
+        deallocate (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +384,67 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.hash_elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      bool loaded;
+
+      inode = hash_entry (e, struct inode, hash_elem);
+      inode->open_cnt++;
+      loaded = inode->loaded;
+      lock_release (&open_inodes_lock);
+
+      /* Wait for the opener that is reading it in. */
+      if (!loaded)
         {
-          inode_reopen (inode);
-          return inode; 
+          rwlock_acquire_read (&inode->rwlock);
+          rwlock_release_read (&inode->rwlock);
         }
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->hash_elem);
+  if (hash_size (&open_inodes) > open_inodes_peak)
+    open_inodes_peak = hash_size (&open_inodes);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->loaded = false;
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->lock);
+  inode->dir_index = NULL;
+  inode->exec_cached = true;
+
+  /* Read the disk inode without holding open_inodes_lock, which
+     would otherwise serialize every open and close behind the
+     disk.  Others that open the inode meanwhile find it in the
+     table and wait on RWLOCK for the read to finish. */
+  rwlock_acquire_write (&inode->rwlock);
+  lock_release (&open_inodes_lock);
+  cache_read (inode->sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loaded = true;
+  lock_release (&open_inodes_lock);
+  rwlock_release_write (&inode->rwlock);
   return inode;
 }
 
@@ -146,7 +453,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,35 +474,119 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->hash_elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+#ifdef USERPROG
+          /* The sector may hold another inode soon. */
+          if (inode->exec_cached)
+            exec_cache_invalidate (inode->sector);
+#endif
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          deallocate (&inode->data);
         }
 
+      dir_index_destroy (inode->dir_index);
       free (inode); 
     }
 }
 
+/* Returns the number of inodes currently open. */
+size_t
+inode_open_count (void)
+{
+  size_t cnt;
+
+  lock_acquire (&open_inodes_lock);
+  cnt = hash_size (&open_inodes);
+  lock_release (&open_inodes_lock);
+  return cnt;
+}
+
+/* Prints open inode statistics.  Does not lock, since it may be
+   called on the way down from a kernel panic. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %zu open, %zu peak\n",
+          hash_size (&open_inodes), open_inodes_peak);
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns true if INODE has been removed, so that it will be
+   deleted when it is last closed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Acquires INODE's lock, which directory.c holds while it looks
+   up or updates the entries of a directory, so that operations
+   on different directories do not contend. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
+
+/* Returns the index that directory.c keeps in memory for
+   directory INODE, or a null pointer if it has none.  The caller
+   must hold INODE's lock. */
+struct dir_index *
+inode_get_dir_index (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  return inode->dir_index;
+}
+
+/* Sets INDEX as directory INODE's index, which is destroyed with
+   dir_index_destroy() when INODE is last closed.  The caller
+   must hold INODE's lock. */
+void
+inode_set_dir_index (struct inode *inode, struct dir_index *index)
+{
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  inode->dir_index = index;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,8 +597,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rwlock);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,50 +615,77 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy the chunk out of the cached sector. */
+      cache_read_at (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* Prefetch the sectors following the last one we touched, on
+     the bet that the caller is reading sequentially.  Only those
+     that are contiguous on disk, so that one disk request brings
+     in all of them. */
+  if (bytes_read > 0 && offset < inode_length (inode))
+    {
+      off_t next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+      if (next < inode_length (inode))
+        {
+          block_sector_t first = byte_to_sector (inode, next);
+          size_t cnt = 1;
+
+          while (cnt < CACHE_READ_AHEAD
+                 && next + (off_t) cnt * BLOCK_SECTOR_SIZE
+                    < inode_length (inode)
+                 && (byte_to_sector (inode,
+                                     next + cnt * BLOCK_SECTOR_SIZE)
+                     == first + cnt))
+            cnt++;
+          cache_readahead (first, cnt);
+        }
+    }
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  A write past end of file
+   extends the inode, allocating sectors as needed; any gap
+   between the old end of file and OFFSET reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_write (&inode->rwlock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rwlock);
+      return 0;
+    }
+
+  /* Grow the file first.  If it cannot grow that far, it keeps
+     its length and the loop below writes only what lies within
+     it. */
+  if (size > 0 && offset + size > inode->data.length
+      && extend (&inode->data, offset + size))
+    cache_write (inode->sector, &inode->data);
+#ifdef USERPROG
+  /* Nobody is running the file, or writes would be denied, but
+     its headers may be cached from an earlier run.  Only the
+     first write since then has to look. */
+  if (size > 0 && inode->exec_cached)
+    {
+      exec_cache_invalidate (inode->sector);
+      inode->exec_cached = false;
+    }
+#endif
 
   while (size > 0) 
     {
@@ -281,38 +703,17 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* The cache reads in the rest of the sector first if the
+         chunk does not cover all of it. */
+      cache_write_at (sector_idx, buffer + bytes_written,
+                      sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  rwlock_release_write (&inode->rwlock);
 
   return bytes_written;
 }
@@ -322,8 +723,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +735,24 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Records that the executable cache may hold metadata read from
+   INODE, so that the next write to INODE has to invalidate it.
+   The flag starts out set, since an entry can outlive the inodes
+   opened on its sector, and each write that invalidates the entry
+   clears it, so that later writes skip the cache and its lock. */
+void
+inode_set_exec_cached (struct inode *inode)
+{
+  rwlock_acquire_write (&inode->rwlock);
+  inode->exec_cached = true;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,10 +24,20 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   FIRST_CLEAR is a hint for bitmap_scan(): every bit below it is
+   known to be true, so a search for false bits can start there.
+   It is lowered whenever a bit below it is cleared and raised
+   when the bit it names is set, so first-fit allocators such as
+   palloc and the free map skip their full prefix without a
+   scan.  Each bit is updated together with the hint with
+   interrupts off, so that a bit operation that would otherwise
+   be atomic cannot leave the hint wrong. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t first_clear; /* No false bit below this index. */
     elem_type *bits;    /* Elements that represent bits. */
   };
 
@@ -82,6 +93,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->first_clear = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +116,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->first_clear = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -158,11 +171,16 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
+  old_level = intr_disable ();
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  if (bit_idx == b->first_clear)
+    b->first_clear++;
+  intr_set_level (old_level);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -171,11 +189,16 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
+  old_level = intr_disable ();
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  if (bit_idx < b->first_clear)
+    b->first_clear = bit_idx;
+  intr_set_level (old_level);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -186,11 +209,16 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
 {
   size_t idx = elem_idx (bit_idx);
   elem_type mask = bit_mask (bit_idx);
+  enum intr_level old_level;
 
+  old_level = intr_disable ();
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  if (bit_idx < b->first_clear)
+    b->first_clear = bit_idx;
+  intr_set_level (old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -245,21 +273,44 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
   return value_cnt;
 }
 
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's bit count if there is none.  Elements
+   with no such bit are skipped whole, and the bit within an
+   element is found with a single find-first-set (`bsf'). */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value) 
+{
+  elem_type invert = value ? 0 : (elem_type) -1;
+  size_t idx = elem_idx (start);
+  size_t last = elem_cnt (b->bit_cnt);
+  elem_type e;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  e = (b->bits[idx] ^ invert) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (e == 0)
+    {
+      if (++idx >= last)
+        return b->bit_cnt;
+      e = b->bits[idx] ^ invert;
+    }
+
+  /* Bits past the end of the last element are ignored here. */
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -291,20 +342,36 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Rather than testing every candidate start, this jumps from the
+   start of each run of VALUE bits to its end and on to the start
+   of the next run, so the cost depends on the number of runs and
+   words crossed, not on CNT. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+  if (!value && start < b->first_clear)
+    start = b->first_clear;
+
+  while (start + cnt <= b->bit_cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t end;
+
+      start = find_next (b, start, value);
+      if (start + cnt > b->bit_cnt)
+        break;
+      end = find_next (b, start, !value);
+      if (end - start >= cnt)
+        return start;
+      start = end;
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +413,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      b->first_clear = 0;
     }
   return success;
 }
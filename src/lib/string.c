@@ -1,5 +1,63 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* Blocks shorter than this many bytes are copied or set one byte
+   at a time, since the setup for string instructions would cost
+   more than it saves. */
+#define WORD_THRESHOLD 16
+
+/* A 32-bit word that may alias any other type. */
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+
+/* Copies SIZE bytes forward from SRC to DST.  Copies single bytes
+   until DST is word-aligned, then whole words with `rep movsl',
+   then the remaining tail bytes.  Safe for overlapping blocks as
+   long as DST is below SRC. */
+static void
+copy_forward (unsigned char *dst, const unsigned char *src, size_t size) 
+{
+  if (size >= WORD_THRESHOLD)
+    {
+      size_t head = -(uintptr_t) dst & (sizeof (word_t) - 1);
+      size_t words = (size - head) / sizeof (word_t);
+
+      size -= head + words * sizeof (word_t);
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* Copies SIZE bytes backward from the ends of SRC and DST, for an
+   overlapping memmove() with DST above SRC.  The same alignment
+   prologue, word loop and byte epilogue as copy_forward(), run in
+   reverse. */
+static void
+copy_backward (unsigned char *dst, const unsigned char *src, size_t size) 
+{
+  dst += size;
+  src += size;
+  if (size >= WORD_THRESHOLD)
+    {
+      while ((uintptr_t) dst & (sizeof (word_t) - 1))
+        {
+          *--dst = *--src;
+          size--;
+        }
+      for (; size >= sizeof (word_t); size -= sizeof (word_t))
+        {
+          dst -= sizeof (word_t);
+          src -= sizeof (word_t);
+          *(word_t *) dst = *(const word_t *) src;
+        }
+    }
+  while (size-- > 0)
+    *--dst = *--src;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,9 +70,7 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
-
+  copy_forward (dst, src, size);
   return dst_;
 }
 
@@ -29,20 +85,12 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
+  if (dst <= src || dst >= src + size) 
+    copy_forward (dst, src, size);
   else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
+    copy_backward (dst, src, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -281,7 +329,21 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  /* Same shape as copy_forward(), storing VALUE replicated into
+     every byte of a word with `rep stosl'. */
+  if (size >= WORD_THRESHOLD)
+    {
+      size_t head = -(uintptr_t) dst & (sizeof (word_t) - 1);
+      size_t words = (size - head) / sizeof (word_t);
+      word_t pattern = (unsigned char) value * 0x01010101u;
+
+      size -= head + words * sizeof (word_t);
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (pattern) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (pattern) : "memory");
+    }
   while (size-- > 0)
     *dst++ = value;
 
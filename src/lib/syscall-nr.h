@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Inter-process communication. */
+    SYS_IPC_SEND = 100,         /* Send a message on a channel. */
+    SYS_IPC_RECEIVE,            /* Receive a message from a channel. */
+    SYS_IPC_SEND_PAGES,         /* Pass pages on a channel. */
+    SYS_IPC_RECEIVE_PAGES,      /* Receive pages from a channel. */
+    SYS_PIPE                    /* Create a pipe. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,33 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+ipc_send (int channel, const void *message, unsigned size)
+{
+  return syscall3 (SYS_IPC_SEND, channel, message, size);
+}
+
+int
+ipc_receive (int channel, void *buffer, unsigned size)
+{
+  return syscall3 (SYS_IPC_RECEIVE, channel, buffer, size);
+}
+
+int
+ipc_send_pages (int channel, void *addr, unsigned page_cnt)
+{
+  return syscall3 (SYS_IPC_SEND_PAGES, channel, addr, page_cnt);
+}
+
+int
+ipc_receive_pages (int channel, void *addr, unsigned page_cnt)
+{
+  return syscall3 (SYS_IPC_RECEIVE_PAGES, channel, addr, page_cnt);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
@@ -15,6 +15,12 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* Largest message passed by ipc_send(), in bytes. */
+#define IPC_MESSAGE_MAX 128
+
+/* Most pages passed by ipc_send_pages(). */
+#define IPC_PAGES_MAX 256
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +51,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Inter-process communication. */
+int ipc_send (int channel, const void *message, unsigned size);
+int ipc_receive (int channel, void *buffer, unsigned size);
+int ipc_send_pages (int channel, void *addr, unsigned page_cnt);
+int ipc_receive_pages (int channel, void *addr, unsigned page_cnt);
+bool pipe (int fds[2]);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,161 @@
+/* Test program and micro-benchmark for memcpy(), memmove() and
+   memset() in lib/string.c.
+
+   Checks the word-at-a-time implementations against simple byte
+   loops for every combination of small size and misalignment,
+   then times both on page-sized blocks.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest block, in bytes, that we check or time. */
+#define MAX_SIZE 4096
+
+/* Number of times each benchmark copies its block. */
+#define BENCH_ITERATIONS 10000
+
+static unsigned char src[MAX_SIZE + 8], dst[MAX_SIZE + 8], ref[MAX_SIZE + 8];
+
+static void byte_copy (unsigned char *, const unsigned char *, size_t);
+static void byte_set (unsigned char *, int, size_t);
+static void fill_random (unsigned char *, size_t);
+static void check_memcpy (size_t size, size_t dst_ofs, size_t src_ofs);
+static void check_memmove (size_t size, size_t dst_ofs, size_t src_ofs);
+static void check_memset (size_t size, size_t ofs);
+static void bench (size_t size);
+
+/* Test and time the block memory functions. */
+void
+test (void)
+{
+  size_t size, a, b;
+
+  printf ("checking small sizes and alignments:");
+  for (size = 0; size < 64; size++)
+    {
+      printf (" %zu", size);
+      for (a = 0; a < 4; a++)
+        {
+          check_memset (size, a);
+          for (b = 0; b < 4; b++)
+            {
+              check_memcpy (size, a, b);
+              check_memmove (size, a, b);
+            }
+        }
+    }
+  printf (" done\n");
+
+  for (size = 64; size <= MAX_SIZE; size *= 4)
+    bench (size);
+
+  printf ("string: PASS\n");
+}
+
+/* Reference memcpy(), one byte at a time. */
+static void
+byte_copy (unsigned char *d, const unsigned char *s, size_t size)
+{
+  while (size-- > 0)
+    *d++ = *s++;
+}
+
+/* Reference memset(), one byte at a time. */
+static void
+byte_set (unsigned char *d, int value, size_t size)
+{
+  while (size-- > 0)
+    *d++ = value;
+}
+
+/* Fills the SIZE bytes at P with random data. */
+static void
+fill_random (unsigned char *p, size_t size)
+{
+  while (size-- > 0)
+    *p++ = random_ulong ();
+}
+
+/* Checks memcpy() of SIZE bytes from SRC + SRC_OFS to DST +
+   DST_OFS, including that bytes outside the block are left
+   alone. */
+static void
+check_memcpy (size_t size, size_t dst_ofs, size_t src_ofs)
+{
+  fill_random (src, sizeof src);
+  fill_random (dst, sizeof dst);
+  byte_copy (ref, dst, sizeof ref);
+  byte_copy (ref + dst_ofs, src + src_ofs, size);
+
+  ASSERT (memcpy (dst + dst_ofs, src + src_ofs, size) == dst + dst_ofs);
+  ASSERT (!memcmp (dst, ref, sizeof dst));
+}
+
+/* Checks memmove() of SIZE bytes within one buffer, from offset
+   SRC_OFS to DST_OFS, so that source and destination overlap. */
+static void
+check_memmove (size_t size, size_t dst_ofs, size_t src_ofs)
+{
+  unsigned char tmp[64];
+
+  fill_random (dst, sizeof dst);
+  byte_copy (ref, dst, sizeof ref);
+  byte_copy (tmp, ref + src_ofs, size);
+  byte_copy (ref + dst_ofs, tmp, size);
+
+  ASSERT (memmove (dst + dst_ofs, dst + src_ofs, size) == dst + dst_ofs);
+  ASSERT (!memcmp (dst, ref, sizeof dst));
+}
+
+/* Checks memset() of SIZE bytes at DST + OFS. */
+static void
+check_memset (size_t size, size_t ofs)
+{
+  int value = random_ulong ();
+
+  fill_random (dst, sizeof dst);
+  byte_copy (ref, dst, sizeof ref);
+  byte_set (ref + ofs, value, size);
+
+  ASSERT (memset (dst + ofs, value, size) == dst + ofs);
+  ASSERT (!memcmp (dst, ref, sizeof dst));
+}
+
+/* Prints the ticks taken by BENCH_ITERATIONS copies and sets of
+   SIZE bytes, with the byte loops and with lib/string.c. */
+static void
+bench (size_t size)
+{
+  int64_t start;
+  int i;
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    byte_copy (dst, src, size);
+  printf ("%5zu bytes: byte copy %"PRId64" ticks, ", size, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    memcpy (dst, src, size);
+  printf ("memcpy %"PRId64" ticks, ", timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    byte_set (dst, i, size);
+  printf ("byte set %"PRId64" ticks, ", timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_ITERATIONS; i++)
+    memset (dst, i, size);
+  printf ("memset %"PRId64" ticks\n", timer_elapsed (start));
+}
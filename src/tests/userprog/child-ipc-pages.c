@@ -0,0 +1,35 @@
+/* Child process run by ipc-pages test.
+
+   Receives the pages sent by its parent, first trying to map
+   them over its own code, which must fail without losing them,
+   and then at an unused address, and verifies their contents. */
+
+#include <stdint.h>
+#include <round.h>
+#include <syscall.h>
+#include "tests/userprog/ipc.h"
+#include "tests/lib.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+int
+main (void) 
+{
+  void *main_page = (void *) ROUND_DOWN ((uintptr_t) main, 4096);
+  size_t i;
+
+  test_name = "child-ipc-pages";
+
+  msg ("begin");
+  CHECK (ipc_receive_pages (IPC_TEST_PAGE_CHANNEL, main_page, 1) == -1,
+         "try to receive over code page");
+  CHECK (ipc_receive_pages (IPC_TEST_PAGE_CHANNEL, ACTUAL, IPC_TEST_PAGES)
+         == IPC_TEST_PAGES, "receive %d pages", IPC_TEST_PAGES);
+  for (i = 0; i < IPC_TEST_PAGES * 4096; i++)
+    if (ACTUAL[i] != IPC_TEST_BYTE (i))
+      fail ("byte %zu of received pages is wrong", i);
+  msg ("verified received pages");
+  msg ("end");
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+/* Child process run by ipc-block test.
+
+   Receives the messages sent by its parent and checks that each
+   one arrives intact and in order. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/ipc.h"
+#include "tests/lib.h"
+
+int
+main (void) 
+{
+  char message[IPC_MESSAGE_MAX];
+  char expected[IPC_MESSAGE_MAX];
+  int i;
+
+  test_name = "child-ipc";
+
+  msg ("begin");
+  for (i = 0; i < IPC_TEST_MESSAGES; i++)
+    {
+      int size = snprintf (expected, sizeof expected, "message %d", i) + 1;
+      int received = ipc_receive (IPC_TEST_CHANNEL, message, sizeof message);
+      if (received != size || memcmp (message, expected, size))
+        fail ("message %d: expected \"%s\"", i, expected);
+    }
+  msg ("received %d messages", IPC_TEST_MESSAGES);
+  msg ("end");
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+/* Child process run by pipe-exec test.
+
+   Writes a message to the pipe write end inherited from its
+   parent, whose descriptor is passed as the first command-line
+   argument. */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/userprog/pipe.h"
+#include "tests/lib.h"
+
+int
+main (int argc UNUSED, char *argv[]) 
+{
+  int fd;
+
+  test_name = "child-pipe";
+
+  if (!isdigit (*argv[1]))
+    fail ("bad command-line arguments");
+  fd = atoi (argv[1]);
+  if (write (fd, PIPE_TEST_MESSAGE, sizeof PIPE_TEST_MESSAGE - 1)
+      != sizeof PIPE_TEST_MESSAGE - 1)
+    fail ("write to inherited pipe failed");
+
+  return 0;
+}
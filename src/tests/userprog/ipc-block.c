@@ -0,0 +1,31 @@
+/* Sends more messages on an IPC channel than it can queue, to a
+   child that receives them one at a time, so that both the
+   sender and the receiver have to block.  The child verifies
+   that every message arrives intact and in order. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/ipc.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char message[IPC_MESSAGE_MAX + 1];
+  pid_t child;
+  int i;
+
+  CHECK (ipc_send (IPC_TEST_CHANNEL, message, sizeof message) == -1,
+         "send oversized message");
+  CHECK (ipc_send (-1, message, 1) == -1, "send on bad channel");
+
+  CHECK ((child = exec ("child-ipc")) != -1, "exec \"child-ipc\"");
+  for (i = 0; i < IPC_TEST_MESSAGES; i++)
+    {
+      int size = snprintf (message, sizeof message, "message %d", i) + 1;
+      if (ipc_send (IPC_TEST_CHANNEL, message, size) != size)
+        fail ("ipc_send of message %d failed", i);
+    }
+  msg ("wait(exec()) = %d", wait (child));
+}
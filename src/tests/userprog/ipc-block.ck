@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ipc-block) begin
+(ipc-block) send oversized message
+(ipc-block) send on bad channel
+(ipc-block) exec "child-ipc"
+(child-ipc) begin
+(child-ipc) received 40 messages
+(child-ipc) end
+child-ipc: exit(0)
+(ipc-block) wait(exec()) = 0
+(ipc-block) end
+ipc-block: exit(0)
+EOF
+pass;
@@ -0,0 +1,31 @@
+/* Passes pages of memory to a child process over an IPC channel
+   and has the child verify their contents.  Also checks that
+   read-only pages, such as code, cannot be passed. */
+
+#include <stdint.h>
+#include <round.h>
+#include <syscall.h>
+#include "tests/userprog/ipc.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char pages[IPC_TEST_PAGES][4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void) 
+{
+  void *test_main_page = (void *) ROUND_DOWN ((uintptr_t) test_main, 4096);
+  size_t i;
+
+  CHECK (ipc_send_pages (IPC_TEST_PAGE_CHANNEL, test_main_page, 1) == -1,
+         "try to send code page");
+  CHECK (ipc_send_pages (IPC_TEST_PAGE_CHANNEL, pages[0] + 1, 1) == -1,
+         "try to send misaligned page");
+
+  for (i = 0; i < sizeof pages; i++)
+    pages[i / 4096][i % 4096] = IPC_TEST_BYTE (i);
+  CHECK (ipc_send_pages (IPC_TEST_PAGE_CHANNEL, pages, IPC_TEST_PAGES)
+         == IPC_TEST_PAGES, "send %d pages", IPC_TEST_PAGES);
+
+  msg ("wait(exec()) = %d", wait (exec ("child-ipc-pages")));
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ipc-pages) begin
+(ipc-pages) try to send code page
+(ipc-pages) try to send misaligned page
+(ipc-pages) send 2 pages
+(child-ipc-pages) begin
+(child-ipc-pages) try to receive over code page
+(child-ipc-pages) receive 2 pages
+(child-ipc-pages) verified received pages
+(child-ipc-pages) end
+child-ipc-pages: exit(0)
+(ipc-pages) wait(exec()) = 0
+(ipc-pages) end
+ipc-pages: exit(0)
+EOF
+pass;
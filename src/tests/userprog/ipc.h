@@ -0,0 +1,19 @@
+#ifndef TESTS_USERPROG_IPC_H
+#define TESTS_USERPROG_IPC_H
+
+/* Channel used by ipc-block and child-ipc. */
+#define IPC_TEST_CHANNEL 5
+
+/* Messages sent, more than a channel can queue. */
+#define IPC_TEST_MESSAGES 40
+
+/* Channel used by ipc-pages and child-ipc-pages. */
+#define IPC_TEST_PAGE_CHANNEL 6
+
+/* Pages sent by ipc-pages. */
+#define IPC_TEST_PAGES 2
+
+/* Byte at offset OFS of the pages sent by ipc-pages. */
+#define IPC_TEST_BYTE(OFS) ((char) ((OFS) * 7 + 3))
+
+#endif /* tests/userprog/ipc.h */
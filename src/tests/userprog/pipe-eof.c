@@ -0,0 +1,31 @@
+/* Checks that reading a pipe whose write end is closed returns
+   the data still buffered and then end of file, and that writing
+   a pipe whose read end is closed fails. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char data[] = "hello";
+  char buf[16];
+  int fds[2];
+
+  CHECK (pipe (fds), "create pipe");
+  CHECK (write (fds[1], data, sizeof data - 1) == sizeof data - 1,
+         "write \"%s\"", data);
+  close (fds[1]);
+  CHECK (read (fds[0], buf, sizeof buf) == sizeof data - 1
+         && !memcmp (buf, data, sizeof data - 1), "read \"%s\"", data);
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "read at end of file");
+  close (fds[0]);
+
+  CHECK (pipe (fds), "create another pipe");
+  close (fds[0]);
+  CHECK (write (fds[1], data, sizeof data - 1) == -1,
+         "write with no reader");
+  close (fds[1]);
+}
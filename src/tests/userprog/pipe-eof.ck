@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-eof) begin
+(pipe-eof) create pipe
+(pipe-eof) write "hello"
+(pipe-eof) read "hello"
+(pipe-eof) read at end of file
+(pipe-eof) create another pipe
+(pipe-eof) write with no reader
+(pipe-eof) end
+pipe-eof: exit(0)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Creates a pipe and runs a child process that inherits its
+   write end and writes a message to it.  The parent closes its
+   own write end and reads until end of file, which arrives only
+   once the child has exited. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/pipe.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char child_cmd[128];
+  char buf[sizeof PIPE_TEST_MESSAGE * 2];
+  size_t ofs = 0;
+  pid_t child;
+  int fds[2];
+  int n;
+
+  CHECK (pipe (fds), "create pipe");
+  snprintf (child_cmd, sizeof child_cmd, "child-pipe %d", fds[1]);
+  CHECK ((child = exec (child_cmd)) != -1, "exec \"child-pipe\"");
+  close (fds[1]);
+
+  while ((n = read (fds[0], buf + ofs, sizeof buf - ofs)) > 0)
+    ofs += n;
+  if (n < 0)
+    fail ("read from pipe failed");
+
+  msg ("wait(exec()) = %d", wait (child));
+  if (ofs != sizeof PIPE_TEST_MESSAGE - 1
+      || memcmp (buf, PIPE_TEST_MESSAGE, ofs))
+    fail ("read %zu bytes, not \"%s\"", ofs, PIPE_TEST_MESSAGE);
+  msg ("read \"%s\"", PIPE_TEST_MESSAGE);
+  close (fds[0]);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-exec) begin
+(pipe-exec) create pipe
+(pipe-exec) exec "child-pipe"
+child-pipe: exit(0)
+(pipe-exec) wait(exec()) = 0
+(pipe-exec) read "hello from child-pipe"
+(pipe-exec) end
+pipe-exec: exit(0)
+EOF
+pass;
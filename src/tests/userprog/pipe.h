@@ -0,0 +1,7 @@
+#ifndef TESTS_USERPROG_PIPE_H
+#define TESTS_USERPROG_PIPE_H
+
+/* Written by child-pipe to the pipe inherited from pipe-exec. */
+#define PIPE_TEST_MESSAGE "hello from child-pipe"
+
+#endif /* tests/userprog/pipe.h */
@@ -32,6 +32,9 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Maximum length of a chain of nested priority donations. */
+#define DONATION_DEPTH_MAX 8
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -102,7 +105,8 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +118,20 @@ sema_up (struct semaphore *sema)
 
 	old_level = intr_disable ();
 	if (!list_empty (&sema->waiters))
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-				struct thread, elem));
+	{
+		/* Priorities can change through donation while threads
+		   wait, so pick the winner now rather than keeping the
+		   list sorted.  The comparator orders by decreasing
+		   priority, so the "minimum" is the first waiter with the
+		   highest priority. */
+		struct list_elem *e = list_min (&sema->waiters,
+				thread_priority_comparator, NULL);
+		list_remove (e);
+		thread_unblock (list_entry (e, struct thread, elem));
+	}
 	sema->value++;
 	intr_set_level (old_level);
+	thread_yield_to_higher ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -181,9 +195,35 @@ lock_init (struct lock *lock)
 	sema_init (&lock->semaphore, 1);
 }
 
+/* Donates the current thread's priority along the chain of
+   lock holders it is waiting behind: the holder of the lock it
+   waits for, the holder of the lock that thread waits for, and
+   so on, up to DONATION_DEPTH_MAX levels.  Interrupts must be
+   off. */
+static void
+donate_priority (void)
+{
+	struct thread *t = thread_current ();
+	int depth;
+
+	for (depth = 0; depth < DONATION_DEPTH_MAX && t->waiting_lock != NULL;
+			depth++)
+	{
+		struct thread *holder = t->waiting_lock->holder;
+
+		if (holder == NULL || holder->priority >= t->priority)
+			break;
+		thread_set_effective_priority (holder, t->priority);
+		t = holder;
+	}
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
-   thread.
+   thread.  While sleeping, the current thread donates its
+   priority to the holder (see donate_priority()).  The
+   multi-level feedback queue scheduler computes priorities
+   itself, so it does not donate.
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -192,13 +232,24 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+	struct thread *cur = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
+	if (lock->holder != NULL && !thread_mlfqs)
+	{
+		cur->waiting_lock = lock;
+		donate_priority ();
+	}
 	sema_down (&lock->semaphore);
-	lock->holder = thread_current ();
-	list_push_back(&thread_current()->lock_list, &lock->elem);
+	cur->waiting_lock = NULL;
+	lock->holder = cur;
+	list_push_back (&cur->lock_list, &lock->elem);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -210,20 +261,25 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
 	if (success){
 		lock->holder = thread_current ();
 		list_push_back(&thread_current()->lock_list, &lock->elem);
 	}
+	intr_set_level (old_level);
 	return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives up any priority donated through LOCK, which may make the
+   current thread yield to the waiter that now gets it.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -231,11 +287,17 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	lock->holder = NULL;
 	list_remove(&lock->elem);
+	if (!thread_mlfqs)
+		thread_refresh_priority (thread_current ());
+	intr_set_level (old_level);
 	sema_up (&lock->semaphore);
 }
 
@@ -255,8 +317,20 @@ struct semaphore_elem
 {
 	struct list_elem elem;              /* List element. */
 	struct semaphore semaphore;         /* This semaphore. */
+	struct thread *thread;              /* Thread waiting on it. */
 };
 
+/* Orders semaphore_elems by decreasing priority of their
+   waiting threads. */
+static bool
+waiter_priority_higher (const struct list_elem *a_,
+		const struct list_elem *b_, void *aux UNUSED)
+{
+	const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem, elem);
+	const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem, elem);
+	return a->thread->priority > b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -299,6 +373,7 @@ cond_wait (struct condition *cond, struct lock *lock)
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
+	waiter.thread = thread_current ();
 	list_push_back (&cond->waiters, &waiter.elem);
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
@@ -306,7 +381,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -321,8 +397,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 	ASSERT (lock_held_by_current_thread (lock));
 
 	if (!list_empty (&cond->waiters))
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-				struct semaphore_elem, elem)->semaphore);
+	{
+		struct list_elem *e = list_min (&cond->waiters,
+				waiter_priority_higher, NULL);
+		list_remove (e);
+		sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+	}
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -339,4 +419,78 @@ cond_broadcast (struct condition *cond, struct lock *lock)
 
 	while (!list_empty (&cond->waiters))
 		cond_signal (cond, lock);
-}
\ No newline at end of file
+}
+
+/* Initializes readers-writer lock RW. */
+void
+rwlock_init (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->readers_ok);
+	cond_init (&rw->writers_ok);
+	rw->readers = 0;
+	rw->waiting_writers = 0;
+	rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.  Favoring waiting writers keeps a steady
+   stream of readers from starving them. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	while (rw->writer || rw->waiting_writers > 0)
+		cond_wait (&rw->readers_ok, &rw->lock);
+	rw->readers++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_signal (&rw->writers_ok, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	rw->waiting_writers++;
+	while (rw->writer || rw->readers > 0)
+		cond_wait (&rw->writers_ok, &rw->lock);
+	rw->waiting_writers--;
+	rw->writer = true;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->lock);
+	ASSERT (rw->writer);
+	rw->writer = false;
+	if (rw->waiting_writers > 0)
+		cond_signal (&rw->writers_ok, &rw->lock);
+	else
+		cond_broadcast (&rw->readers_ok, &rw->lock);
+	lock_release (&rw->lock);
+}
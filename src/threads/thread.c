@@ -4,6 +4,8 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -11,11 +13,12 @@
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/syscall.h"
-/* Global shared buffer for IPC. */
-struct ipc_buffer shared_ipc_buffer;
 #endif
 
 /* Random value for struct thread's `magic' member.
@@ -28,9 +31,15 @@ bool foreach_finished = false;
 
 static void release_locks (struct thread * t);
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, with one FIFO queue per
+   priority.  Bit P of ready_bits is set exactly when
+   ready_queues[P] is nonempty, so the highest ready priority is
+   found with a bit scan instead of a list walk. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+static struct list ready_queues[PRI_CNT];
+static uint32_t ready_bits[(PRI_CNT + 31) / 32];
+static int ready_cnt;           /* Threads in all of ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -67,6 +76,10 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_INTERVAL 4 /* Ticks between priority updates. */
+static fixed_t load_avg;        /* System load average. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -78,6 +91,13 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -95,16 +115,15 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+	int i;
+
 	ASSERT (intr_get_level () == INTR_OFF);
 
 	lock_init (&tid_lock);
-	list_init (&ready_list);
+	for (i = 0; i < PRI_CNT; i++)
+		list_init (&ready_queues[i]);
 	list_init (&all_list);
 
-	/* Initialize the shared IPC buffer and semaphore. */
-	sema_init(&shared_ipc_buffer.sema, 1); /* Semaphore starts as available */
-	memset(shared_ipc_buffer.data, 0, IPC_BUFFER_SIZE);
-
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
@@ -146,6 +165,9 @@ thread_tick (void)
 	else
 		kernel_ticks++;
 
+	if (thread_mlfqs)
+		mlfqs_tick (t);
+
 	/* Enforce preemption. */
 	if (++thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
@@ -171,9 +193,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running one,
+   it preempts it before thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
 		thread_func *function, void *aux)
@@ -215,13 +236,23 @@ thread_create (const char *name, int priority,
 
 	intr_set_level (old_level);
 
+#ifdef FILESYS
+	/* Inherit the working directory. */
+	if (thread_current ()->cwd != NULL)
+		t->cwd = dir_reopen (thread_current ()->cwd);
+#endif
+
+#ifdef USERPROG
 	/* Add child process to list */
 	t->parent = thread_tid();
 	add_child_process(t->tid, thread_current());
 	t->cp = get_child_process(t->tid, thread_current());
+	process_inherit_pipes (t);
+#endif
 
 	/* Add to run queue. */
 	thread_unblock (t);
+	thread_yield_to_higher ();
 
 	return tid;
 }
@@ -260,13 +291,7 @@ thread_unblock (struct thread *t)
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
 
-	/* Insert thread in the ready list based on priority (if MLFQS or priority scheduling is used). */
-    if (thread_mlfqs) {
-        list_insert_ordered(&ready_list, &t->elem, thread_priority_comparator, NULL);
-    } else {
-        list_push_back(&ready_list, &t->elem);
-    }
-
+	ready_push (t);
 	t->status = THREAD_READY;
 	intr_set_level (old_level);
 }
@@ -338,7 +363,7 @@ thread_yield (void)
 
 	old_level = intr_disable ();
 	if (cur != idle_thread)
-		list_push_back (&ready_list, &cur->elem);
+		ready_push (cur);
 	cur->status = THREAD_READY;
 	schedule ();
 	intr_set_level (old_level);
@@ -361,11 +386,91 @@ thread_foreach (thread_action_func *func, void *aux)
 	}
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU if a ready thread has a higher priority than
+   the running one.  From an interrupt handler, the yield happens
+   on return from the interrupt.  A caller that turned interrupts
+   off is not preempted; it is expected to finish its atomic
+   update, and the next timer tick or yield will switch. */
+void
+thread_yield_to_higher (void)
+{
+	enum intr_level old_level = intr_disable ();
+	bool higher = ready_max_priority () > thread_current ()->priority;
+
+	intr_set_level (old_level);
+	if (!higher || thread_current () == idle_thread)
+		return;
+	if (intr_context ())
+		intr_yield_on_return ();
+	else if (old_level == INTR_ON)
+		thread_yield ();
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Interrupts must be off. */
+void
+thread_set_effective_priority (struct thread *t, int priority)
+{
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	if (t->status == THREAD_READY)
+	{
+		ready_remove (t);
+		t->priority = priority;
+		ready_push (t);
+	}
+	else
+		t->priority = priority;
+}
+
+/* Recomputes T's effective priority as the larger of its base
+   priority and the priorities of the threads waiting for the
+   locks it holds.  Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t)
+{
+	struct list_elem *le, *we;
+	int priority = t->base_priority;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (le = list_begin (&t->lock_list); le != list_end (&t->lock_list);
+			le = list_next (le))
+	{
+		struct lock *lock = list_entry (le, struct lock, elem);
+		struct list *waiters = &lock->semaphore.waiters;
+
+		for (we = list_begin (waiters); we != list_end (waiters);
+				we = list_next (we))
+		{
+			struct thread *w = list_entry (we, struct thread, elem);
+			if (w->priority > priority)
+				priority = w->priority;
+		}
+	}
+	thread_set_effective_priority (t, priority);
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY.  Its
+   effective priority stays raised while it holds a lock that a
+   higher-priority thread is waiting for.  Yields if the thread no
+   longer has the highest priority.  Ignored under the multi-level
+   feedback queue scheduler, which sets priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-	thread_current ()->priority = new_priority;
+	enum intr_level old_level;
+
+	ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+	if (thread_mlfqs)
+		return;
+
+	old_level = intr_disable ();
+	thread_current ()->base_priority = new_priority;
+	thread_refresh_priority (thread_current ());
+	intr_set_level (old_level);
+	thread_yield_to_higher ();
 }
 
 /* Returns the current thread's priority. */
@@ -375,35 +480,118 @@ thread_get_priority (void)
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-	/* Not yet implemented. */
+	enum intr_level old_level;
+
+	ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+	old_level = intr_disable ();
+	thread_current ()->nice = nice;
+	if (thread_mlfqs)
+		mlfqs_update_priority (thread_current (), NULL);
+	intr_set_level (old_level);
+	thread_yield_to_higher ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-	/* Not yet implemented. */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-	/* Not yet implemented. */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int load_avg_100 = fp_round (load_avg * 100);
+	intr_set_level (old_level);
+	return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-	/* Not yet implemented. */
-	return 0;
+	enum intr_level old_level = intr_disable ();
+	int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+	intr_set_level (old_level);
+	return recent_cpu_100;
+}
+
+/* Returns the priority the multi-level feedback queue scheduler
+   assigns to T, based on its recent_cpu and nice values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+	int priority = PRI_MAX - fp_to_int (t->recent_cpu / 4) - t->nice * 2;
+
+	if (priority < PRI_MIN)
+		return PRI_MIN;
+	else if (priority > PRI_MAX)
+		return PRI_MAX;
+	return priority;
+}
+
+/* Recomputes T's priority, moving it to the matching run queue if
+   it is ready.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+	if (t == idle_thread)
+		return;
+	t->base_priority = mlfqs_priority (t);
+	thread_set_effective_priority (t, t->base_priority);
+}
+
+/* Decays T's recent_cpu by the current load average. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+	fixed_t twice_load = load_avg * 2;
+
+	if (t == idle_thread)
+		return;
+	t->recent_cpu = fp_add_int (fp_mul (fp_div (twice_load,
+					fp_add_int (twice_load, 1)), t->recent_cpu), t->nice);
+}
+
+/* Multi-level feedback queue bookkeeping for one timer tick, in
+   which CUR was running.  Interrupts are off.
+
+   Between the once-a-second recent_cpu decay, only the running
+   thread's recent_cpu changes, so the periodic priority update
+   only has to look at CUR; the whole thread list is walked once
+   a second, right after the decay. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+	int64_t ticks = timer_ticks ();
+
+	if (cur != idle_thread)
+		cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+	if (ticks % TIMER_FREQ == 0)
+	{
+		int ready_threads = ready_cnt + (cur != idle_thread);
+
+		load_avg = fp_mul (fp_div (fp_from_int (59), fp_from_int (60)), load_avg)
+			+ fp_from_int (ready_threads) / 60;
+		thread_foreach (mlfqs_update_recent_cpu, NULL);
+		thread_foreach (mlfqs_update_priority, NULL);
+	}
+	else if (ticks % MLFQS_PRIORITY_INTERVAL == 0)
+		mlfqs_update_priority (cur, NULL);
+	else
+		return;
+
+	thread_yield_to_higher ();
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -489,7 +677,17 @@ init_thread (struct thread *t, const char *name, int priority)
 	t->status = THREAD_BLOCKED;
 	strlcpy (t->name, name, sizeof t->name);
 	t->stack = (uint8_t *) t + PGSIZE;
-	t->priority = priority;
+	t->priority = t->base_priority = priority;
+	t->waiting_lock = NULL;
+	if (thread_mlfqs)
+	{
+		/* Inherit the creating thread's values.  For the initial
+		   thread, running_thread() is T itself, already zeroed. */
+		struct thread *parent = running_thread ();
+		t->nice = parent->nice;
+		t->recent_cpu = parent->recent_cpu;
+		t->priority = t->base_priority = mlfqs_priority (t);
+	}
 	t->magic = THREAD_MAGIC;
 	list_push_back (&all_list, &t->allelem);
 
@@ -497,11 +695,13 @@ init_thread (struct thread *t, const char *name, int priority)
 	t->executable = NULL;
 
 	list_init(&t->lock_list);
-	list_init(&t->file_list);
 	list_init(&t->child_list);
-	t->fd = 2;
 	t->cp = NULL;
 	t->parent = -1;
+#ifdef VM
+	list_init (&t->mappings);
+	t->next_mapid = 0;
+#endif
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -525,10 +725,46 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-	if (list_empty (&ready_list))
+	int priority = ready_max_priority ();
+	struct thread *t;
+
+	if (priority < 0)
 		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	t = list_entry (list_front (&ready_queues[priority]), struct thread, elem);
+	ready_remove (t);
+	return t;
+}
+
+/* Appends T to the run queue for its priority. */
+static void
+ready_push (struct thread *t)
+{
+	ready_cnt++;
+	list_push_back (&ready_queues[t->priority], &t->elem);
+	ready_bits[t->priority / 32] |= 1u << (t->priority % 32);
+}
+
+/* Removes T, which must be ready, from its run queue. */
+static void
+ready_remove (struct thread *t)
+{
+	ready_cnt--;
+	list_remove (&t->elem);
+	if (list_empty (&ready_queues[t->priority]))
+		ready_bits[t->priority / 32] &= ~(1u << (t->priority % 32));
+}
+
+/* Returns the highest priority with a ready thread, or -1 if no
+   thread is ready. */
+static int
+ready_max_priority (void)
+{
+	int i;
+
+	for (i = sizeof ready_bits / sizeof *ready_bits - 1; i >= 0; i--)
+		if (ready_bits[i] != 0)
+			return i * 32 + 31 - __builtin_clz (ready_bits[i]);
+	return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
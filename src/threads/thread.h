@@ -4,20 +4,9 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/synch.h"
 
-/* IPC buffer size */
-#define IPC_BUFFER_SIZE 128
-
-/* IPC buffer for inter-process communication */
-struct ipc_buffer {
-    char data[IPC_BUFFER_SIZE];
-    struct semaphore sema; /* Semaphore to synchronize access. */
-};
-
-/* Declare a global IPC buffer */
-extern struct ipc_buffer shared_ipc_buffer;
-
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -37,6 +26,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values, for the multi-level feedback queue. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* struct to store information of child process */
 struct child_process {
 	int pid;
@@ -112,26 +106,45 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
+    int nice;                           /* Niceness, for -o mlfqs. */
+    fixed_t recent_cpu;                 /* Fixed point, for -o mlfqs. */
     struct list_elem allelem;           /* List element for all threads list. */
 
-    /* Shared between thread.c and synch.c. */
+    /* Shared between thread.c, synch.c and devices/timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by devices/timer.c. */
+    int64_t wake_tick;                  /* Tick to wake up at. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+
+    /* Owned by userprog/syscall.c. */
+    void *user_esp;                     /* User esp on entry to kernel. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
 
     /* locks current thread holding */
     struct list lock_list;
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
 
-    /* file system syscall */
-    struct list file_list;
-    int fd;
+    /* file system syscall: open files and pipes indexed by descriptor */
+    struct fd *fd_table;                /* FD_CAP slots, used if set in FD_MAP. */
+    struct bitmap *fd_map;              /* Set bit = descriptor in use. */
+    size_t fd_cap;                      /* Capacity of both of the above. */
 
     /* wait and exec syscall */
     struct list child_list;
@@ -142,6 +155,11 @@ struct thread
 
     /* used to deny writes to executables */
     struct file* executable;
+
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, null for root. */
+#endif
   };
 
 /* If false (default), use round-robin scheduler.
@@ -174,6 +192,9 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_yield_to_higher (void);
+void thread_set_effective_priority (struct thread *, int priority);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -5,6 +5,10 @@
 #include <user/syscall.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -149,6 +153,34 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in a page that the process has but that is not loaded
+     yet, or a new page just below its stack.  This applies to
+     faults taken in the kernel as well, on behalf of a system
+     call. */
+  if (not_present && is_user_vaddr (fault_addr))
+    {
+      /* In kernel context, f->esp is the kernel's stack pointer, so
+         use the one the process had when it entered the kernel. */
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+
+      if (page_load (fault_addr) || page_grow_stack (fault_addr, esp))
+        return;
+    }
+#endif
+
+  /* A fault on a user address taken in kernel context comes from
+     the kernel probing user memory on behalf of a system call
+     (see get_user() and put_user() in syscall.c).  Those stash
+     the address to resume at in eax; report the failure there
+     with -1 and let the probe return. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
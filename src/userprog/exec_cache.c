@@ -0,0 +1,155 @@
+#include "userprog/exec_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Cached metadata for one executable.
+
+   The key is the sector of the executable's inode, which stays
+   the same for as long as the file exists.  The file system
+   calls exec_cache_invalidate() whenever the inode is written or
+   its sectors are freed, so an entry never outlives the contents
+   it was read from.  To keep that off the write path, the inode
+   is flagged when an entry is added (see inode_set_exec_cached()),
+   and writes to an unflagged inode do not call in here. */
+struct exec_entry
+  {
+    block_sector_t sector;      /* Inode sector. */
+    struct hash_elem hash_elem; /* Element in `entries'. */
+    struct list_elem lru_elem;  /* Element in `lru'. */
+    struct exec_info info;      /* Must be last: variable size. */
+  };
+
+static struct lock cache_lock;  /* Protects everything below. */
+static struct hash entries;     /* Entries keyed by sector. */
+static struct list lru;         /* Entries, most recently used first. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static struct exec_entry *find (block_sector_t);
+static void evict (struct exec_entry *);
+
+/* Returns the size in bytes of INFO, including its segments. */
+static size_t
+info_size (const struct exec_info *info)
+{
+  return sizeof *info + info->segment_cnt * sizeof *info->segments;
+}
+
+/* Initializes the executable metadata cache. */
+void
+exec_cache_init (void)
+{
+  lock_init (&cache_lock);
+  hash_init (&entries, entry_hash, entry_less, NULL);
+  list_init (&lru);
+}
+
+/* Returns a copy of the metadata cached for the executable whose
+   inode is at SECTOR, which the caller must free(), or a null
+   pointer if there is none or memory is short. */
+struct exec_info *
+exec_cache_get (block_sector_t sector)
+{
+  struct exec_entry *e;
+  struct exec_info *info = NULL;
+
+  lock_acquire (&cache_lock);
+  e = find (sector);
+  if (e != NULL)
+    {
+      list_remove (&e->lru_elem);
+      list_push_front (&lru, &e->lru_elem);
+      info = malloc (info_size (&e->info));
+      if (info != NULL)
+        memcpy (info, &e->info, info_size (&e->info));
+    }
+  lock_release (&cache_lock);
+  return info;
+}
+
+/* Caches a copy of INFO as the metadata of the executable in
+   INODE, replacing the least recently used entry if the cache is
+   full.  The caller must have denied writes to the
+   inode before reading INFO from it, so that no write can slip in
+   between the read and this call.  Does nothing if memory is
+   short. */
+void
+exec_cache_put (struct inode *inode, const struct exec_info *info)
+{
+  block_sector_t sector = inode_get_inumber (inode);
+  struct exec_entry *e, *old;
+
+  e = malloc (offsetof (struct exec_entry, info) + info_size (info));
+  if (e == NULL)
+    return;
+  e->sector = sector;
+  memcpy (&e->info, info, info_size (info));
+
+  inode_set_exec_cached (inode);
+  lock_acquire (&cache_lock);
+  old = find (sector);
+  if (old != NULL)
+    evict (old);
+  else if (hash_size (&entries) >= EXEC_CACHE_SIZE)
+    evict (list_entry (list_back (&lru), struct exec_entry, lru_elem));
+  hash_insert (&entries, &e->hash_elem);
+  list_push_front (&lru, &e->lru_elem);
+  lock_release (&cache_lock);
+}
+
+/* Drops any metadata cached for the inode at SECTOR. */
+void
+exec_cache_invalidate (block_sector_t sector)
+{
+  struct exec_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = find (sector);
+  if (e != NULL)
+    evict (e);
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry for SECTOR, or a null pointer if there is
+   none.  The cache lock must be held. */
+static struct exec_entry *
+find (block_sector_t sector)
+{
+  struct exec_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&entries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct exec_entry, hash_elem) : NULL;
+}
+
+/* Removes E from the cache and frees it.  The cache lock must be
+   held. */
+static void
+evict (struct exec_entry *e)
+{
+  hash_delete (&entries, &e->hash_elem);
+  list_remove (&e->lru_elem);
+  free (e);
+}
+
+/* Returns a hash value for exec_entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct exec_entry, hash_elem)->sector);
+}
+
+/* Returns true if exec_entry A precedes exec_entry B. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct exec_entry, hash_elem)->sector
+          < hash_entry (b, struct exec_entry, hash_elem)->sector);
+}
@@ -0,0 +1,38 @@
+#ifndef USERPROG_EXEC_CACHE_H
+#define USERPROG_EXEC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+struct inode;
+
+/* Executables whose metadata is kept. */
+#define EXEC_CACHE_SIZE 16
+
+/* A loadable segment, as passed to load_segment(). */
+struct exec_segment
+  {
+    uint32_t file_page;         /* Page-aligned offset in the file. */
+    uint32_t mem_page;          /* Page-aligned user virtual address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after them. */
+    bool writable;              /* Writable by the process? */
+  };
+
+/* What load() needs from an executable's headers, once they have
+   been read and validated. */
+struct exec_info
+  {
+    uint32_t entry;             /* Entry point. */
+    size_t segment_cnt;         /* Number of SEGMENTS. */
+    struct exec_segment segments[];
+  };
+
+void exec_cache_init (void);
+struct exec_info *exec_cache_get (block_sector_t);
+void exec_cache_put (struct inode *, const struct exec_info *);
+void exec_cache_invalidate (block_sector_t);
+
+#endif /* userprog/exec_cache.h */
@@ -0,0 +1,396 @@
+#include "userprog/ipc.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
+
+/* A message waiting in a channel. */
+struct message
+  {
+    size_t size;                /* Number of bytes in DATA. */
+    uint8_t data[];             /* Contents. */
+  };
+
+/* Pages waiting in a channel.  Each is a handle returned by
+   give_page(), mapped by no process until it is received.  The
+   pages are charged to the sender: they are freed if it exits
+   before they are received, because the frame table cannot evict
+   them in the meantime. */
+struct page_message
+  {
+    tid_t sender;               /* Sending process. */
+    size_t page_cnt;            /* Number of pages. */
+    void *pages[];              /* The pages, in address order. */
+  };
+
+/* A bounded queue of messages.  Senders block while the queue is
+   full and receivers while it is empty, so no message is ever
+   dropped or overwritten. */
+struct queue
+  {
+    struct condition not_empty;         /* Signaled after a send. */
+    struct condition not_full;          /* Signaled after a receive. */
+    void *ring[IPC_QUEUE_LEN];          /* Queued messages. */
+    size_t head;                        /* Index of the oldest. */
+    size_t cnt;                         /* Number queued. */
+  };
+
+/* A channel.  Byte messages and page messages are queued
+   separately, so that each kind of receive gets the kind of
+   message it expects. */
+struct channel
+  {
+    struct lock lock;                   /* Protects the queues. */
+    struct queue data;                  /* struct message. */
+    struct queue pages;                 /* struct page_message. */
+  };
+
+static struct channel channels[IPC_CHANNEL_CNT];
+
+/* Pages in all page messages queued, at most
+   IPC_PAGES_QUEUED_MAX. */
+static struct lock queued_lock;
+static size_t pages_queued;
+
+static void queue_init (struct queue *);
+static void push (struct channel *, struct queue *, void *);
+static void *pop (struct channel *, struct queue *);
+static void *give_page (void *upage);
+static bool take_page (void *upage, void *page);
+static void free_page (void *page);
+static bool reserve_pages (size_t page_cnt);
+static void release_pages (size_t page_cnt);
+
+/* Initializes the IPC channels. */
+void
+ipc_init (void)
+{
+  struct channel *c;
+
+  for (c = channels; c < channels + IPC_CHANNEL_CNT; c++)
+    {
+      lock_init (&c->lock);
+      queue_init (&c->data);
+      queue_init (&c->pages);
+    }
+  lock_init (&queued_lock);
+  pages_queued = 0;
+}
+
+/* Frees the pages the current process has sent that are still
+   waiting to be received.  Called when the process exits. */
+void
+ipc_exit (void)
+{
+  tid_t tid = thread_current ()->tid;
+  struct channel *c;
+
+  for (c = channels; c < channels + IPC_CHANNEL_CNT; c++)
+    {
+      struct queue *q = &c->pages;
+      size_t i, kept = 0;
+
+      lock_acquire (&c->lock);
+      for (i = 0; i < q->cnt; i++)
+        {
+          struct page_message *m = q->ring[(q->head + i) % IPC_QUEUE_LEN];
+          if (m->sender == tid)
+            {
+              size_t j;
+
+              for (j = 0; j < m->page_cnt; j++)
+                free_page (m->pages[j]);
+              release_pages (m->page_cnt);
+              free (m);
+            }
+          else
+            q->ring[(q->head + kept++) % IPC_QUEUE_LEN] = m;
+        }
+      if (kept < q->cnt)
+        {
+          q->cnt = kept;
+          cond_broadcast (&q->not_full, &c->lock);
+        }
+      lock_release (&c->lock);
+    }
+}
+
+/* Returns channel number CHANNEL, or a null pointer if there is
+   no such channel. */
+static struct channel *
+get_channel (int channel)
+{
+  return (channel >= 0 && channel < IPC_CHANNEL_CNT
+          ? &channels[channel] : NULL);
+}
+
+/* Queues the SIZE bytes at DATA as a message on CHANNEL, waiting
+   for room if the channel is full.  DATA must be in kernel
+   memory, since the caller may block.  Returns false if there is
+   no such channel, SIZE exceeds IPC_MESSAGE_MAX or memory is
+   short. */
+bool
+ipc_send (int channel, const void *data, size_t size)
+{
+  struct channel *c = get_channel (channel);
+  struct message *m;
+
+  if (c == NULL || size > IPC_MESSAGE_MAX)
+    return false;
+  m = malloc (sizeof *m + size);
+  if (m == NULL)
+    return false;
+  m->size = size;
+  memcpy (m->data, data, size);
+
+  push (c, &c->data, m);
+  return true;
+}
+
+/* Takes the oldest message off CHANNEL, waiting for one if the
+   channel is empty, and copies up to SIZE bytes of it into
+   BUFFER, which must be in kernel memory; see ipc_send().  The
+   rest of a longer message is lost.  Returns the number of bytes
+   copied, or -1 if there is no such channel. */
+int
+ipc_receive (int channel, void *buffer, size_t size)
+{
+  struct channel *c = get_channel (channel);
+  struct message *m;
+
+  if (c == NULL)
+    return -1;
+
+  m = pop (c, &c->data);
+  if (size > m->size)
+    size = m->size;
+  memcpy (buffer, m->data, size);
+  free (m);
+  return size;
+}
+
+/* Returns true if the PAGE_CNT pages starting at UPAGE are a
+   sensible range of user pages to pass. */
+static bool
+check_range (const void *upage, size_t page_cnt)
+{
+  const uint8_t *base = upage;
+
+  return (base != NULL && pg_ofs (base) == 0
+          && page_cnt > 0 && page_cnt <= IPC_PAGES_MAX
+          && is_user_vaddr (base)
+          && page_cnt <= (size_t) ((uint8_t *) PHYS_BASE - base) / PGSIZE);
+}
+
+/* Moves the PAGE_CNT pages of the current process starting at
+   UPAGE onto CHANNEL, waiting for room if the channel is full.
+   The pages are unmapped from the sender and later mapped into
+   the receiver as they are, so the cost depends on the number of
+   pages, not on the number of bytes in them.  Each page must be
+   mapped and writable; under VM it must also be private, neither
+   memory-mapped nor shared.  Returns false, leaving every page
+   where it was, if there is no such channel, the range is bad,
+   IPC_PAGES_QUEUED_MAX pages would be queued or memory is
+   short. */
+bool
+ipc_send_pages (int channel, void *upage, size_t page_cnt)
+{
+  struct channel *c = get_channel (channel);
+  struct page_message *m;
+  uint8_t *base = upage;
+  size_t i;
+
+  if (c == NULL || !check_range (upage, page_cnt))
+    return false;
+  if (!reserve_pages (page_cnt))
+    return false;
+  m = malloc (sizeof *m + page_cnt * sizeof *m->pages);
+  if (m == NULL)
+    {
+      release_pages (page_cnt);
+      return false;
+    }
+  m->sender = thread_current ()->tid;
+  m->page_cnt = page_cnt;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      m->pages[i] = give_page (base + i * PGSIZE);
+      if (m->pages[i] == NULL)
+        {
+          /* Put back what we already took.  The addresses were
+             just vacated, so this cannot fail for lack of room,
+             but under VM it needs memory for the page table
+             entries. */
+          while (i-- > 0)
+            if (!take_page (base + i * PGSIZE, m->pages[i]))
+              free_page (m->pages[i]);
+          free (m);
+          release_pages (page_cnt);
+          return false;
+        }
+    }
+
+  push (c, &c->pages, m);
+  return true;
+}
+
+/* Takes the oldest page message off CHANNEL, waiting for one if
+   there is none, and maps up to PAGE_CNT of its pages into the
+   current process starting at UPAGE, which must be unmapped.
+   Pages beyond PAGE_CNT are freed.  Returns the number of pages
+   mapped, or -1 if there is no such channel or the range is bad
+   or already in use. */
+int
+ipc_receive_pages (int channel, void *upage, size_t page_cnt)
+{
+  struct channel *c = get_channel (channel);
+  struct page_message *m;
+  uint8_t *base = upage;
+  size_t i, mapped;
+
+  if (c == NULL || !check_range (upage, page_cnt))
+    return -1;
+  for (i = 0; i < page_cnt; i++)
+#ifdef VM
+    if (page_lookup (base + i * PGSIZE) != NULL)
+#else
+    if (pagedir_get_page (thread_current ()->pagedir,
+                          base + i * PGSIZE) != NULL)
+#endif
+      return -1;
+
+  m = pop (c, &c->pages);
+  release_pages (m->page_cnt);
+  mapped = 0;
+  for (i = 0; i < m->page_cnt; i++)
+    if (i == mapped && i < page_cnt && take_page (base + i * PGSIZE,
+                                                   m->pages[i]))
+      mapped++;
+    else
+      free_page (m->pages[i]);
+  free (m);
+  return mapped;
+}
+
+/* Initializes Q as an empty queue. */
+static void
+queue_init (struct queue *q)
+{
+  cond_init (&q->not_empty);
+  cond_init (&q->not_full);
+  q->head = q->cnt = 0;
+}
+
+/* Adds M to queue Q in channel C, waiting for room. */
+static void
+push (struct channel *c, struct queue *q, void *m)
+{
+  lock_acquire (&c->lock);
+  while (q->cnt == IPC_QUEUE_LEN)
+    cond_wait (&q->not_full, &c->lock);
+  q->ring[(q->head + q->cnt++) % IPC_QUEUE_LEN] = m;
+  cond_signal (&q->not_empty, &c->lock);
+  lock_release (&c->lock);
+}
+
+/* Removes and returns the oldest message in queue Q in channel
+   C, waiting for one. */
+static void *
+pop (struct channel *c, struct queue *q)
+{
+  void *m;
+
+  lock_acquire (&c->lock);
+  while (q->cnt == 0)
+    cond_wait (&q->not_empty, &c->lock);
+  m = q->ring[q->head];
+  q->head = (q->head + 1) % IPC_QUEUE_LEN;
+  q->cnt--;
+  cond_signal (&q->not_full, &c->lock);
+  lock_release (&c->lock);
+  return m;
+}
+
+/* Unmaps the current process's page at UPAGE and returns a handle
+   on the memory behind it, for take_page() or free_page(), or a
+   null pointer if UPAGE cannot be passed. */
+static void *
+give_page (void *upage)
+{
+#ifdef VM
+  return page_detach (upage);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+  void *kpage;
+
+  /* The receiver maps the page writable, so code and other
+     read-only pages must not be passed. */
+  if (!pagedir_is_writable (pd, upage))
+    return NULL;
+  kpage = pagedir_get_page (pd, upage);
+  pagedir_clear_page (pd, upage);
+  return kpage;
+#endif
+}
+
+/* Maps PAGE, obtained from give_page(), at UPAGE in the current
+   process, writable.  Returns false, leaving PAGE alone, on
+   failure. */
+static bool
+take_page (void *upage, void *page)
+{
+#ifdef VM
+  return page_attach (upage, page);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+
+  return (pagedir_get_page (pd, upage) == NULL
+          && pagedir_set_page (pd, upage, page, true));
+#endif
+}
+
+/* Counts PAGE_CNT more pages as queued.  Returns false if that
+   would exceed IPC_PAGES_QUEUED_MAX. */
+static bool
+reserve_pages (size_t page_cnt)
+{
+  bool ok;
+
+  lock_acquire (&queued_lock);
+  ok = page_cnt <= IPC_PAGES_QUEUED_MAX - pages_queued;
+  if (ok)
+    pages_queued += page_cnt;
+  lock_release (&queued_lock);
+  return ok;
+}
+
+/* Counts PAGE_CNT fewer pages as queued. */
+static void
+release_pages (size_t page_cnt)
+{
+  lock_acquire (&queued_lock);
+  ASSERT (pages_queued >= page_cnt);
+  pages_queued -= page_cnt;
+  lock_release (&queued_lock);
+}
+
+/* Frees PAGE, obtained from give_page(). */
+static void
+free_page (void *page)
+{
+#ifdef VM
+  frame_free (page);
+#else
+  palloc_free_page (page);
+#endif
+}
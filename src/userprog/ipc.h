@@ -0,0 +1,29 @@
+#ifndef USERPROG_IPC_H
+#define USERPROG_IPC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of IPC channels, numbered from 0. */
+#define IPC_CHANNEL_CNT 64
+
+/* Largest message, in bytes. */
+#define IPC_MESSAGE_MAX 128
+
+/* Messages a channel holds before senders block. */
+#define IPC_QUEUE_LEN 16
+
+/* Most pages passed in one message. */
+#define IPC_PAGES_MAX 256
+
+/* Most pages queued in all channels together. */
+#define IPC_PAGES_QUEUED_MAX 1024
+
+void ipc_init (void);
+void ipc_exit (void);
+bool ipc_send (int channel, const void *, size_t size);
+int ipc_receive (int channel, void *, size_t size);
+bool ipc_send_pages (int channel, void *upage, size_t page_cnt);
+int ipc_receive_pages (int channel, void *upage, size_t page_cnt);
+
+#endif /* userprog/ipc.h */
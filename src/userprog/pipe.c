@@ -0,0 +1,166 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* An anonymous pipe: a ring buffer of PIPE_SIZE bytes with a read
+   end and a write end, each of which may be open in any number of
+   descriptors.  Readers block while the pipe is empty and writers
+   while it is full.  A read of an empty pipe with no writers left
+   returns 0, for end of file; a write with no readers left
+   fails. */
+struct pipe
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition not_empty; /* Signaled when data or EOF arrives. */
+    struct condition not_full;  /* Signaled when room appears or the
+                                   last reader goes away. */
+    uint8_t *buffer;            /* PIPE_SIZE bytes. */
+    size_t head;                /* Offset of the oldest byte. */
+    size_t cnt;                 /* Number of bytes buffered. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+  };
+
+/* Creates a pipe with one open read end and one open write end.
+   Returns a null pointer if memory is short. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->buffer = palloc_get_page (0);
+  if (p->buffer == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  lock_init (&p->lock);
+  cond_init (&p->not_empty);
+  cond_init (&p->not_full);
+  p->head = p->cnt = 0;
+  p->readers = p->writers = 1;
+  return p;
+}
+
+/* Opens another write end of P if WRITER is true, otherwise
+   another read end. */
+void
+pipe_reopen (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Closes a write end of P if WRITER is true, otherwise a read
+   end, and frees P once no end is left open.  Closing the last
+   end of either kind wakes up anyone blocked at the other. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool dead;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    {
+      ASSERT (p->writers > 0);
+      if (--p->writers == 0)
+        cond_broadcast (&p->not_empty, &p->lock);
+    }
+  else
+    {
+      ASSERT (p->readers > 0);
+      if (--p->readers == 0)
+        cond_broadcast (&p->not_full, &p->lock);
+    }
+  dead = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    {
+      palloc_free_page (p->buffer);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, waiting until at
+   least one byte is available or no writer is left.  Returns the
+   number of bytes read, which is 0 only at end of file.
+
+   BUFFER is written with P's lock held and the caller may have
+   waited a long time for it, so it must be in kernel memory; the
+   read() syscall copies out to the user afterward. */
+int
+pipe_read (struct pipe *p, void *buffer_, size_t size)
+{
+  uint8_t *buffer = buffer_;
+  size_t n, chunk;
+
+  if (size == 0)
+    return 0;
+
+  lock_acquire (&p->lock);
+  while (p->cnt == 0 && p->writers > 0)
+    cond_wait (&p->not_empty, &p->lock);
+
+  n = size < p->cnt ? size : p->cnt;
+  chunk = PIPE_SIZE - p->head;
+  if (chunk > n)
+    chunk = n;
+  memcpy (buffer, p->buffer + p->head, chunk);
+  memcpy (buffer + chunk, p->buffer, n - chunk);
+  p->head = (p->head + n) % PIPE_SIZE;
+  p->cnt -= n;
+  if (n > 0)
+    cond_broadcast (&p->not_full, &p->lock);
+  lock_release (&p->lock);
+  return n;
+}
+
+/* Writes the SIZE bytes in BUFFER to P, waiting for room as
+   necessary.  Returns the number of bytes written, which is less
+   than SIZE only if the last reader went away, or -1 if no reader
+   was left before anything could be written.
+
+   BUFFER must be in kernel memory; see pipe_read(). */
+int
+pipe_write (struct pipe *p, const void *buffer_, size_t size)
+{
+  const uint8_t *buffer = buffer_;
+  size_t written = 0;
+
+  lock_acquire (&p->lock);
+  while (written < size)
+    {
+      size_t tail, n, chunk;
+
+      while (p->cnt == PIPE_SIZE && p->readers > 0)
+        cond_wait (&p->not_full, &p->lock);
+      if (p->readers == 0)
+        break;
+
+      tail = (p->head + p->cnt) % PIPE_SIZE;
+      n = size - written;
+      if (n > PIPE_SIZE - p->cnt)
+        n = PIPE_SIZE - p->cnt;
+      chunk = PIPE_SIZE - tail;
+      if (chunk > n)
+        chunk = n;
+      memcpy (p->buffer + tail, buffer + written, chunk);
+      memcpy (p->buffer, buffer + written + chunk, n - chunk);
+      p->cnt += n;
+      written += n;
+      cond_broadcast (&p->not_empty, &p->lock);
+    }
+  lock_release (&p->lock);
+
+  return written > 0 || size == 0 ? (int) written : -1;
+}
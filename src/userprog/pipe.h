@@ -0,0 +1,18 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Bytes a pipe holds before writers block. */
+#define PIPE_SIZE 4096
+
+struct pipe;
+
+struct pipe *pipe_create (void);
+void pipe_reopen (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+int pipe_read (struct pipe *, void *, size_t size);
+int pipe_write (struct pipe *, const void *, size_t size);
+
+#endif /* userprog/pipe.h */
@@ -1,16 +1,21 @@
 #include "userprog/process.h"
+#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/exec_cache.h"
 #include "userprog/gdt.h"
+#include "userprog/ipc.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -19,6 +24,10 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 /* external integer to represent state, shared from syscall.c*/
 
@@ -31,7 +40,8 @@ extern const int LOAD_FAIL;
 /* boolean flag from thread.c */
 extern bool thread_alive;
 
-#define MAX_FD 128  // Maximum number of file descriptors per process
+#define MAX_FD 1024     // Maximum number of file descriptors per process
+#define FD_INIT_CAP 16  // Initial size of a process's descriptor table
 
 /* Used for setup_stack */
 static void final_stack_push(int order, void **esp, char *token, char **argv, int argc);
@@ -138,13 +148,24 @@ process_exit (void)
 	struct thread *cur = thread_current ();
 	uint32_t *pd;
 
+	/* Free the pages we sent that nobody has received. */
+	ipc_exit ();
+
+#ifdef VM
+	/* Write back and drop our pages while the files backing them
+	   are still open: shared executable pages are keyed by the
+	   executable's inode. */
+	mmap_unmap_all ();
+	page_table_destroy (cur);
+#endif
+
 	/* closing all files which were opened by the process */
-	lock_acquire(&filesys_lock);
 	current_process_close_file(CLOSE_ALL, thread_current());
 	if (cur->executable){
 		file_close(cur->executable);
 	}
-	lock_release(&filesys_lock);
+	dir_close (cur->cwd);
+	cur->cwd = NULL;
 
 	/* remove all child from child list and update state */
 	remove_children(thread_current());
@@ -258,6 +279,7 @@ struct Elf32_Phdr
 
 /* redefined setup_stack to take save_ptr as argument */
 static bool setup_stack (void **esp, const char* file_name,	char** save_ptr);
+static struct exec_info *read_exec_info (struct file *, const char *file_name);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
@@ -271,20 +293,23 @@ bool
 load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
 {
 	struct thread *t = thread_current ();
-	struct Elf32_Ehdr ehdr;
+	struct exec_info *info = NULL;
 	struct file *file = NULL;
-	off_t file_ofs;
+	block_sector_t sector;
 	bool success = false;
-	int i;
+	size_t i;
 
 	/* Allocate and activate page directory. */
 	t->pagedir = pagedir_create ();
 	if (t->pagedir == NULL)
 		goto done;
+#ifdef VM
+	if (!page_table_init (t))
+		goto done;
+#endif
 	process_activate ();
 
 	/* Open executable file. */
-	lock_acquire(&filesys_lock);
 	file = filesys_open (file_name);
 	if (file == NULL)
 	{
@@ -294,7 +319,57 @@ load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
 	file_deny_write(file);
 	t->executable = file;
 
+	/* Get the executable's headers, from the cache if this file
+     has been run before.  Writes are already denied, so nothing
+     can change the file between reading and caching them. */
+	sector = inode_get_inumber (file_get_inode (file));
+	info = exec_cache_get (sector);
+	if (info == NULL)
+	{
+		info = read_exec_info (file, file_name);
+		if (info == NULL)
+			goto done;
+		exec_cache_put (file_get_inode (file), info);
+	}
+
+	/* Load the segments. */
+	for (i = 0; i < info->segment_cnt; i++)
+	{
+		const struct exec_segment *s = &info->segments[i];
+		if (!load_segment (file, s->file_page, (void *) s->mem_page,
+				s->read_bytes, s->zero_bytes, s->writable))
+			goto done;
+	}
+
+	/* Set up stack. */
+	if (!setup_stack (esp, file_name, save_ptr))
+		goto done;
+
+	/* Start address. */
+	*eip = (void (*) (void)) info->entry;
+
+	success = true;
+
+	done:
+	/* We arrive here whether the load is successful or not. */
+	free (info);
+	return success;
+}
+
+/* Reads and verifies the executable header and program headers
+   of FILE, and returns the entry point and loadable segments they
+   describe, which the caller must free(), or a null pointer if
+   FILE is not an executable we can load or memory is short. */
+static struct exec_info *
+read_exec_info (struct file *file, const char *file_name)
+{
+	struct Elf32_Ehdr ehdr;
+	struct exec_info *info;
+	off_t file_ofs;
+	int i;
+
 	/* Read and verify executable header. */
+	file_seek (file, 0);
 	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
 			|| memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
 			|| ehdr.e_type != 2
@@ -304,9 +379,15 @@ load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
 			|| ehdr.e_phnum > 1024)
 	{
 		printf ("load: %s: error loading executable\n", file_name);
-		goto done;
+		return NULL;
 	}
 
+	info = malloc (sizeof *info + ehdr.e_phnum * sizeof *info->segments);
+	if (info == NULL)
+		return NULL;
+	info->entry = ehdr.e_entry;
+	info->segment_cnt = 0;
+
 	/* Read program headers. */
 	file_ofs = ehdr.e_phoff;
 	for (i = 0; i < ehdr.e_phnum; i++)
@@ -314,11 +395,11 @@ load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
 		struct Elf32_Phdr phdr;
 
 		if (file_ofs < 0 || file_ofs > file_length (file))
-			goto done;
+			goto fail;
 		file_seek (file, file_ofs);
 
 		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
+			goto fail;
 		file_ofs += sizeof phdr;
 		switch (phdr.p_type)
 		{
@@ -332,58 +413,48 @@ load (const char *file_name, void (**eip) (void), void **esp, char **save_ptr)
 		case PT_DYNAMIC:
 		case PT_INTERP:
 		case PT_SHLIB:
-			goto done;
+			goto fail;
 		case PT_LOAD:
 			if (validate_segment (&phdr, file))
 			{
-				bool writable = (phdr.p_flags & PF_W) != 0;
-				uint32_t file_page = phdr.p_offset & ~PGMASK;
-				uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+				struct exec_segment *s = &info->segments[info->segment_cnt++];
 				uint32_t page_offset = phdr.p_vaddr & PGMASK;
-				uint32_t read_bytes, zero_bytes;
+				s->writable = (phdr.p_flags & PF_W) != 0;
+				s->file_page = phdr.p_offset & ~PGMASK;
+				s->mem_page = phdr.p_vaddr & ~PGMASK;
 				if (phdr.p_filesz > 0)
 				{
 					/* Normal segment.
                      Read initial part from disk and zero the rest. */
-					read_bytes = page_offset + phdr.p_filesz;
-					zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-							- read_bytes);
+					s->read_bytes = page_offset + phdr.p_filesz;
+					s->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+							- s->read_bytes);
 				}
 				else
 				{
 					/* Entirely zero.
                      Don't read anything from disk. */
-					read_bytes = 0;
-					zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+					s->read_bytes = 0;
+					s->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
 				}
-				if (!load_segment (file, file_page, (void *) mem_page,
-						read_bytes, zero_bytes, writable))
-					goto done;
 			}
 			else
-				goto done;
+				goto fail;
 			break;
 		}
 	}
+	return info;
 
-	/* Set up stack. */
-	if (!setup_stack (esp, file_name, save_ptr))
-		goto done;
-
-	/* Start address. */
-	*eip = (void (*) (void)) ehdr.e_entry;
-
-	success = true;
-
-	done:
-	/* We arrive here whether the load is successful or not. */
-	lock_release(&filesys_lock);
-	return success;
+	fail:
+	free (info);
+	return NULL;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -442,6 +513,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only recorded in the
+   supplemental page table here and read in when first touched,
+   so FILE must stay open while the process runs.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -452,6 +527,23 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+	while (read_bytes > 0 || zero_bytes > 0)
+	{
+		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+		size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+		if (!page_add_file (file, ofs, upage, page_read_bytes, writable))
+			return false;
+
+		/* Advance. */
+		read_bytes -= page_read_bytes;
+		zero_bytes -= page_zero_bytes;
+		ofs += page_read_bytes;
+		upage += PGSIZE;
+	}
+	return true;
+#else
 	file_seek (file, ofs);
 	while (read_bytes > 0 || zero_bytes > 0)
 	{
@@ -487,6 +579,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		upage += PGSIZE;
 	}
 	return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -494,27 +587,29 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool 
 setup_stack(void **esp, const char *file_name, char **save_ptr) 
 {
-    uint8_t *kpage;
-    bool success = false;
+    uint8_t *upage = ((uint8_t *)PHYS_BASE) - PGSIZE;
+    bool success = true;
 
-    kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+#ifdef VM
+    if (!page_add_zero(upage, true) || !page_load(upage))
+        return false;
+#else
+    uint8_t *kpage = palloc_get_page(PAL_USER | PAL_ZERO);
     if (kpage == NULL)
         return false;
 
-    success = install_page(((uint8_t *)PHYS_BASE) - PGSIZE, kpage, true);
-    if (!success) {
+    if (!install_page(upage, kpage, true)) {
         palloc_free_page(kpage);
         return false;
     }
+#endif
 
     *esp = PHYS_BASE;
 
     // Prepare argv array dynamically
     char **argv = malloc(2 * sizeof(char *));
-    if (argv == NULL) {
-        palloc_free_page(kpage);
+    if (argv == NULL)
         return false;
-    }
 
     int argc = 0, argv_size = 2;
     char *token = (char *)file_name;
@@ -529,7 +624,6 @@ setup_stack(void **esp, const char *file_name, char **save_ptr)
             char **new_argv = realloc(argv, argv_size * sizeof(char *));
             if (new_argv == NULL) {
                 free(argv);
-                palloc_free_page(kpage);
                 return false;
             }
             argv = new_argv;
@@ -566,6 +660,7 @@ setup_stack(void **esp, const char *file_name, char **save_ptr)
 }
 
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -585,71 +680,191 @@ install_page (void *upage, void *kpage, bool writable)
 	return (pagedir_get_page (t->pagedir, upage) == NULL
 			&& pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
 
-/* Add the given file to the current process and return its file descriptor. */
-int
-current_process_add_file(struct file *f, struct thread *t) 
+/* Grows T's descriptor table to hold at least one more descriptor,
+   doubling its capacity up to MAX_FD.  Descriptors 0 and 1 are
+   reserved for the console.  Returns false if out of memory or if
+   the table is already at MAX_FD. */
+static bool
+grow_fd_table(struct thread *t)
 {
-    struct process_file *pf = malloc(sizeof(struct process_file));
+    size_t new_cap = t->fd_cap == 0 ? FD_INIT_CAP : t->fd_cap * 2;
+    struct fd *new_table;
+    struct bitmap *new_map;
 
-    if (!pf)
-        return ERROR;
+    if (new_cap > MAX_FD)
+        new_cap = MAX_FD;
+    if (new_cap <= t->fd_cap)
+        return false;
 
-    pf->file = f;
+    new_map = bitmap_create(new_cap);
+    if (new_map == NULL)
+        return false;
+    new_table = realloc(t->fd_table, new_cap * sizeof *new_table);
+    if (new_table == NULL) {
+        bitmap_destroy(new_map);
+        return false;
+    }
 
-	/* Ensuring file descriptors don't exceed a limit */
-    if (t->fd >= MAX_FD) {
-        free(pf);
-        return ERROR;
+    /* Every slot below the old capacity is in use, or we would not
+       be growing, so the new map only needs those bits set. */
+    bitmap_set_multiple(new_map, 0, t->fd_cap > 2 ? t->fd_cap : 2, true);
+
+    bitmap_destroy(t->fd_map);
+    t->fd_map = new_map;
+    t->fd_table = new_table;
+    t->fd_cap = new_cap;
+    return true;
+}
+
+/* Add an entry of the given type to T's descriptor table and
+   return its descriptor, which is the lowest one not currently
+   open, or ERROR if the table is full. */
+static int
+add_fd(struct thread *t, enum fd_type type, struct file *file, struct pipe *pipe)
+{
+    size_t fd = t->fd_map != NULL
+                ? bitmap_scan_and_flip(t->fd_map, 0, 1, false)
+                : BITMAP_ERROR;
+
+    if (fd == BITMAP_ERROR) {
+        if (!grow_fd_table(t))
+            return ERROR;
+        fd = bitmap_scan_and_flip(t->fd_map, 0, 1, false);
     }
 
-    pf->fd = t->fd++;
-    list_push_back(&t->file_list, &pf->elem);
+    t->fd_table[fd].type = type;
+    t->fd_table[fd].file = file;
+    t->fd_table[fd].pipe = pipe;
+    return fd;
+}
 
-    return pf->fd;
+/* Return T's entry for the given file descriptor, or NULL if it is
+   not open.  The console descriptors have no entry. */
+static struct fd *
+get_fd(int fd, struct thread *t)
+{
+    if (t == NULL || fd < 2 || (size_t) fd >= t->fd_cap
+        || !bitmap_test(t->fd_map, fd))
+        return NULL; // Return NULL if input is invalid.
+
+    return &t->fd_table[fd];
 }
 
-/* Return the file associated with the given file descriptor. */
+/* Close whatever the descriptor table entry D refers to. */
+static void
+close_fd(struct fd *d)
+{
+    if (d->type == FD_FILE)
+        file_close(d->file);
+    else
+        pipe_close(d->pipe, d->type == FD_PIPE_WRITER);
+}
+
+/* Add the given file to the current process and return its file
+   descriptor, which is the lowest one not currently open. */
+int
+current_process_add_file(struct file *f, struct thread *t) 
+{
+    return add_fd(t, FD_FILE, f, NULL);
+}
+
+/* Return the file associated with the given file descriptor, or
+   NULL if it is not open or refers to a pipe. */
 struct file *
 current_process_get_file(int fd, struct thread *t) 
 {
-    if (t == NULL || fd < 0) 
-        return NULL; // Return NULL if input is invalid.
+    struct fd *d = get_fd(fd, t);
 
-    struct list_elem *e = list_begin(&t->file_list);
+    return d != NULL && d->type == FD_FILE ? d->file : NULL;
+}
 
-    while (e != list_end(&t->file_list)) {
-        struct process_file *pf = list_entry(e, struct process_file, elem);
-        if (pf != NULL && pf->fd == fd)
-            return pf->file;
-        e = list_next(e);
-    }
-    return NULL;
+/* Add an end of the given pipe, its write end if WRITER is true,
+   to the current process and return its file descriptor.  The
+   descriptor takes over the caller's reference to that end. */
+int
+current_process_add_pipe(struct pipe *p, bool writer, struct thread *t)
+{
+    return add_fd(t, writer ? FD_PIPE_WRITER : FD_PIPE_READER, NULL, p);
+}
+
+/* Return the pipe whose write end (if WRITER is true) or read end
+   (otherwise) is open as the given file descriptor, or NULL. */
+struct pipe *
+current_process_get_pipe(int fd, bool writer, struct thread *t)
+{
+    struct fd *d = get_fd(fd, t);
+
+    return d != NULL && d->type == (writer ? FD_PIPE_WRITER : FD_PIPE_READER)
+           ? d->pipe : NULL;
 }
 
 /* Close the file associated with the given file descriptor.
-   If `fd` is CLOSE_ALL, close all open files. */
+   If `fd` is CLOSE_ALL, close all open files and free the table. */
 void
 current_process_close_file(int fd, struct thread *t) 
 {
     if (t == NULL) 
         return; // Do nothing if thread is NULL.
 
-    struct list_elem *e = list_begin(&t->file_list);
+    if (fd == CLOSE_ALL) {
+        size_t i;
+
+        for (i = 2; i < t->fd_cap; i++)
+            if (bitmap_test(t->fd_map, i))
+                close_fd(&t->fd_table[i]);
+        free(t->fd_table);
+        bitmap_destroy(t->fd_map);
+        t->fd_table = NULL;
+        t->fd_map = NULL;
+        t->fd_cap = 0;
+        return;
+    }
 
-    while (e != list_end(&t->file_list)) {
-        struct process_file *pf = list_entry(e, struct process_file, elem);
-        struct list_elem *next = list_next(e); // Store next element before potential removal.
+    struct fd *d = get_fd(fd, t);
+    if (d != NULL) {
+        close_fd(d);
+        bitmap_reset(t->fd_map, fd);
+    }
+}
 
-        if (pf != NULL && (fd == pf->fd || fd == CLOSE_ALL)) {
-            file_close(pf->file);
-            list_remove(&pf->elem);
-            free(pf);
+/* Give the new process T, which has not started running, the
+   current process's pipe descriptors under the same numbers, so
+   that a parent can create a pipe and tell the children it runs
+   which descriptors to use.  Files are not inherited.  If memory
+   is short, T inherits nothing. */
+void
+process_inherit_pipes(struct thread *t)
+{
+    struct thread *cur = thread_current();
+    size_t i;
+
+    for (i = 2; i < cur->fd_cap; i++)
+        if (bitmap_test(cur->fd_map, i) && cur->fd_table[i].type != FD_FILE)
+            break;
+    if (i >= cur->fd_cap)
+        return;
 
-            if (fd != CLOSE_ALL) 
-                break; // If not closing all files, stop after the match.
+    t->fd_table = malloc(cur->fd_cap * sizeof *t->fd_table);
+    t->fd_map = bitmap_create(cur->fd_cap);
+    if (t->fd_table == NULL || t->fd_map == NULL) {
+        free(t->fd_table);
+        bitmap_destroy(t->fd_map);
+        t->fd_table = NULL;
+        t->fd_map = NULL;
+        return;
+    }
+    t->fd_cap = cur->fd_cap;
+
+    bitmap_set_multiple(t->fd_map, 0, 2, true);
+    for (; i < cur->fd_cap; i++) {
+        struct fd *d = &cur->fd_table[i];
+        if (bitmap_test(cur->fd_map, i) && d->type != FD_FILE) {
+            pipe_reopen(d->pipe, d->type == FD_PIPE_WRITER);
+            t->fd_table[i] = *d;
+            bitmap_mark(t->fd_map, i);
         }
-        e = next; // Move to the next element.
     }
 }
 
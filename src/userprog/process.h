@@ -4,23 +4,35 @@
 #include "threads/thread.h"
 #include "userprog/syscall.h"
 
-/* the file that this process has */
-struct process_file {
-	int fd;
-	struct file *file;
-	struct list_elem elem;
-};
-
 /* original function from pintos */
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 
+/* What a file descriptor refers to. */
+enum fd_type
+  {
+    FD_FILE,            /* Open file or directory. */
+    FD_PIPE_READER,     /* Read end of a pipe. */
+    FD_PIPE_WRITER      /* Write end of a pipe. */
+  };
+
+/* Entry in a process's descriptor table. */
+struct fd
+  {
+    enum fd_type type;
+    struct file *file;  /* For FD_FILE. */
+    struct pipe *pipe;  /* For FD_PIPE_READER and FD_PIPE_WRITER. */
+  };
+
 /* function header added for project 2: process_file struct */
 int current_process_add_file (struct file *f, struct thread * t);
 struct file* current_process_get_file (int fd, struct thread * t);
 void current_process_close_file (int fd, struct thread * t);
+int current_process_add_pipe (struct pipe *p, bool writer, struct thread * t);
+struct pipe* current_process_get_pipe (int fd, bool writer, struct thread * t);
+void process_inherit_pipes (struct thread * t);
 
 /* function header added for child_process struct */
 void add_child_process (int pid, struct thread * t);
@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "devices/input.h"
 #include "devices/shutdown.h"
@@ -7,8 +8,10 @@
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
-#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Exit status constants */
 const int CLOSE_ALL = -1;
@@ -17,117 +20,237 @@ const int NOT_LOADED = 0;
 const int LOAD_SUCCESS = 1;
 const int LOAD_FAIL = 2;
 
-/* Filesystem lock */
-struct lock filesys_lock;
-
 /* Syscall usage metrics */
-static int syscall_usage[SYS_IPC_RECEIVE + 1] = {0}; // Tracks usage count of each syscall
+static int syscall_usage[SYS_PIPE + 1] = {0}; // Tracks usage count of each syscall
 
 /* Function prototypes */
 static void syscall_handler(struct intr_frame *f);
 static void load_syscall_args(struct intr_frame *f, int *arg, int n);
-static int num_syscall_args(int syscall_code);
+static void check_pointer_args(const struct syscall_mapping *sc, int *arg);
+#ifdef VM
+static void pin_buffer_args(const struct syscall_mapping *sc, int *arg, bool pin);
+#endif
+static bool probe_user_range(const void *uaddr, size_t size, bool writable);
 static void log_syscall(const char *syscall_name, int *args, int arg_count, int result);
 static void track_syscall_usage(int syscall_code);
 
 /* Syscall initialization */
 void syscall_init(void) {
-    lock_init(&filesys_lock);
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
 /* Main syscall handler */
 static void syscall_handler(struct intr_frame *f) {
-    int arg[3];
-    int *esp = (int *)f->esp;
+    int arg[SYSCALL_MAX_ARGS];
+
+#ifdef VM
+    /* Page faults taken on behalf of the process need its stack pointer */
+    thread_current()->user_esp = f->esp;
+#endif
 
-    /* Verify the stack pointer */
-    if (!is_valid_pointer((void *)esp)) {
+    /* Fetch the syscall code and find its table entry */
+    load_syscall_args(f, arg, 0);
+    int syscall_code = *(int *)f->esp;
+    const struct syscall_mapping *sc = lookup_syscall(syscall_code);
+    if (sc == NULL) {
         terminate_process(ERROR);
     }
 
-    int syscall_code = *esp;
-    int arg_count = num_syscall_args(syscall_code);
-
     /* Track syscall usage */
     track_syscall_usage(syscall_code);
 
-    /* Load syscall arguments from the stack */
-    load_syscall_args(f, arg, arg_count);
+    /* Load syscall arguments from the stack and check the pointers among them */
+    load_syscall_args(f, arg, sc->arg_count);
+    check_pointer_args(sc, arg);
 
-    /* Dispatch the syscall using the handler mapping in syscall_handlers.c */
-    call_syscall_handler(syscall_code, f, arg);
+#ifdef VM
+    if (sc->pins_own_buffers) {
+        sc->handler(f, arg);
+        return;
+    }
+    pin_buffer_args(sc, arg, true);
+    sc->handler(f, arg);
+    pin_buffer_args(sc, arg, false);
+#else
+    sc->handler(f, arg);
+#endif
 }
 
-/* Load syscall arguments from the stack */
+/* Load N syscall arguments from the stack, after the syscall code.
+   The whole range esp..esp+4*(N+1) is checked and copied at once. */
 static void load_syscall_args(struct intr_frame *f, int *arg, int n) {
-    for (int i = 0; i < n; i++) {
-        int *esp = (int *)f->esp + i + 1;
-        if (!is_valid_pointer((void *)esp)) {
+    int *esp = (int *)f->esp;
+
+    if (!probe_user_range(esp, (n + 1) * sizeof *esp, false)) {
+        terminate_process(ERROR);
+    }
+    memcpy(arg, esp + 1, n * sizeof *arg);
+}
+
+/* Check every pointer argument of a syscall against the table metadata */
+static void check_pointer_args(const struct syscall_mapping *sc, int *arg) {
+    for (int i = 0; i < sc->arg_count; i++) {
+        switch (sc->arg_types[i]) {
+            case ARG_STRING:
+                validate_string((const void *)arg[i]);
+                break;
+            case ARG_IN_BUFFER:
+            case ARG_OUT_BUFFER:
+                ASSERT(i + 1 < sc->arg_count);
+                validate_buffer((void *)arg[i], (unsigned)arg[i + 1],
+                                sc->arg_types[i] == ARG_OUT_BUFFER);
+                break;
+            case ARG_VALUE:
+                break;
+        }
+    }
+}
+
+#ifdef VM
+/* Pin (or, if PIN is false, unpin) the user buffers passed to a
+   syscall.  The file system touches them while holding inode
+   locks, and faulting one in then could need the same locks
+   (executable pages) or evict a page whose owner holds them.
+   Handlers that may block for a long time, such as read() on a
+   pipe, set pins_own_buffers and pin only around the file system
+   call, so that nothing stays pinned while they wait. */
+static void pin_buffer_args(const struct syscall_mapping *sc, int *arg, bool pin) {
+    for (int i = 0; i < sc->arg_count; i++) {
+        if (sc->arg_types[i] != ARG_IN_BUFFER && sc->arg_types[i] != ARG_OUT_BUFFER) {
+            continue;
+        }
+        if (!pin) {
+            page_unpin_range((const void *)arg[i], (unsigned)arg[i + 1]);
+        } else if (!page_pin_range((const void *)arg[i], (unsigned)arg[i + 1])) {
             terminate_process(ERROR);
         }
-        arg[i] = *esp;
     }
 }
+#endif
+
+/* User memory is probed by simply touching it.  If the access
+   faults, page_fault() in exception.c notices that the kernel
+   faulted on a user address, stores -1 in eax and resumes at the
+   address that was in eax, which get_user() and put_user() point
+   at the instruction right after the access.  Probing a page
+   therefore costs one memory access instead of a page table walk. */
+
+/* Reads a byte at user virtual address UADDR, which must be below
+   PHYS_BASE.  Returns the byte value if successful, -1 if a
+   segfault occurred. */
+static int get_user(const uint8_t *uaddr) {
+    int result;
+    asm ("movl $1f, %0; movzbl %1, %0; 1:"
+         : "=&a" (result) : "m" (*uaddr));
+    return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a segfault
+   occurred. */
+static bool put_user(uint8_t *udst, uint8_t byte) {
+    int error_code;
+    asm ("movl $1f, %0; movb %b2, %1; 1:"
+         : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+    return error_code != -1;
+}
+
+/* Returns true if the SIZE bytes of user memory at UADDR lie below
+   PHYS_BASE and are mapped, and writable too if WRITABLE is true.
+   Touches one byte per page. */
+static bool probe_user_range(const void *uaddr, size_t size, bool writable) {
+    const uint8_t *p = uaddr;
+    const uint8_t *end = p + size;
+
+    if (size == 0) {
+        return true;
+    }
+    if (end < p || !is_user_vaddr(end - 1)) {
+        return false;
+    }
+    for (; p < end; p = (const uint8_t *)pg_round_down(p) + PGSIZE) {
+        int byte = get_user(p);
+        if (byte == -1) {
+            return false;
+        }
+        if (writable && !put_user((uint8_t *)p, byte)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-/* Determine the number of arguments for a syscall */
-static int num_syscall_args(int syscall_code) {
-    switch (syscall_code) {
-        case SYS_HALT:
-        case SYS_EXIT:
-        case SYS_EXEC:
-        case SYS_WAIT:
-        case SYS_REMOVE:
-        case SYS_OPEN:
-        case SYS_FILESIZE:
-        case SYS_TELL:
-        case SYS_CLOSE:
-            return 1;
-        case SYS_CREATE:
-        case SYS_SEEK:
-            return 2;
-        case SYS_READ:
-        case SYS_WRITE:
-            return 3;
-        default:
-            return 0;
+/* Copy SIZE bytes from user address USRC to kernel address DST.
+   Returns false without copying anything if the user range is bad. */
+bool copy_from_user(void *dst, const void *usrc, size_t size) {
+    if (!probe_user_range(usrc, size, false)) {
+        return false;
     }
+    memcpy(dst, usrc, size);
+    return true;
 }
 
-/* Convert user virtual address to kernel virtual address */
-int convert_user_vaddr(const void *vaddr) {
-    if (!is_valid_pointer(vaddr)) {
-        terminate_process(ERROR);
+/* Copy SIZE bytes from kernel address SRC to user address UDST.
+   Returns false without copying anything if the user range is bad. */
+bool copy_to_user(void *udst, const void *src, size_t size) {
+    if (!probe_user_range(udst, size, true)) {
+        return false;
     }
+    memcpy(udst, src, size);
+    return true;
+}
 
-    void *ptr = pagedir_get_page(thread_current()->pagedir, vaddr);
-    if (ptr == NULL) {
-        terminate_process(ERROR);
+/* Copy the null-terminated user string USRC into DST, which has room
+   for SIZE bytes.  Returns the length of the string, SIZE if it does
+   not fit (DST is then not null-terminated), or -1 if USRC runs into
+   unmapped or kernel memory. */
+int strncpy_from_user(char *dst, const char *usrc, size_t size) {
+    const uint8_t *p = (const uint8_t *)usrc;
+    size_t len;
+
+    for (len = 0; len < size; len++, p++) {
+        int byte = is_user_vaddr(p) ? get_user(p) : -1;
+        if (byte == -1) {
+            return -1;
+        }
+        dst[len] = byte;
+        if (byte == '\0') {
+            return len;
+        }
     }
-    return (int)(uintptr_t)ptr; // Safely cast pointer to int
+    return size;
 }
 
 /* Validate a user-provided pointer */
 bool is_valid_pointer(const void *vaddr) {
     return (vaddr != NULL &&
             is_user_vaddr(vaddr) &&
-            pagedir_get_page(thread_current()->pagedir, vaddr) != NULL);
+            get_user(vaddr) != -1);
 }
 
-/* Validate a user-provided buffer */
-void validate_buffer(void *buffer, unsigned size) {
-    char *buf = (char *)buffer;
-    for (unsigned i = 0; i < size; i++) {
-        if (!is_valid_pointer((const void *)&buf[i])) {
-            terminate_process(ERROR);
-        }
+/* Validate a user-provided buffer, which the kernel is going to
+   write into if WRITABLE is true */
+void validate_buffer(const void *buffer, unsigned size, bool writable) {
+    if (buffer == NULL || !probe_user_range(buffer, size, writable)) {
+        terminate_process(ERROR);
     }
 }
 
-/* Validate a user-provided string */
+/* Validate a user-provided string, probing each page it spans once */
 void validate_string(const void *str) {
-    for (const char *s = (const char *)str; is_valid_pointer(s) && *s != '\0'; s++) {
-        // No action needed, just validate each byte
+    const char *s = str;
+
+    for (;;) {
+        if (!is_valid_pointer(s)) {
+            terminate_process(ERROR);
+        }
+        /* The rest of this page is mapped too */
+        const char *page_end = (const char *)pg_round_down(s) + PGSIZE;
+        for (; s < page_end; s++) {
+            if (*s == '\0') {
+                return;
+            }
+        }
     }
 }
 
@@ -145,7 +268,7 @@ static void log_syscall(const char *syscall_name, int *args, int arg_count, int
 
 /* Track syscall usage metrics */
 static void track_syscall_usage(int syscall_code) {
-    if (syscall_code >= 0 && syscall_code <= SYS_IPC_RECEIVE) {
+    if (syscall_code >= 0 && syscall_code <= SYS_PIPE) {
         syscall_usage[syscall_code]++;
     }
 }
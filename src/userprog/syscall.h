@@ -11,12 +11,7 @@
 /* Define pid_t explicitly as int to avoid undefined type errors */
 typedef int pid_t;
 
-/* Syscall codes for IPC */
-#define SYS_IPC_SEND 100    /* Code for sending IPC messages */
-#define SYS_IPC_RECEIVE 101 /* Code for receiving IPC messages */
 #define SYSCALL_MAX 20 // Maximum number of syscalls to track
-/* Filesystem lock (shared across files) */
-extern struct lock filesys_lock;
 
 /* Common constants for syscall handling */
 extern const int CLOSE_ALL;    /* Special file descriptor to close all files */
@@ -26,10 +21,23 @@ extern const int LOAD_SUCCESS; /* Indicates a process loaded successfully */
 extern const int LOAD_FAIL;    /* Indicates a process failed to load */
 extern int syscall_usage_count[SYSCALL_MAX]; // Declare syscall usage tracking array
 
-/* Struct for mapping syscalls to their handlers */
+/* Maximum number of arguments taken by any syscall */
+#define SYSCALL_MAX_ARGS 3
+
+/* How the dispatcher checks a syscall argument before calling the handler */
+enum syscall_arg_type {
+    ARG_VALUE,      /* Plain value, not checked */
+    ARG_STRING,     /* Null-terminated string in user memory */
+    ARG_IN_BUFFER,  /* User buffer read by the kernel, size in the next argument */
+    ARG_OUT_BUFFER  /* User buffer written by the kernel, size in the next argument */
+};
+
+/* Entry of the syscall table, which is indexed by syscall code */
 struct syscall_mapping {
-    int syscall_code; /* The syscall code (e.g., SYS_EXIT) */
-    void (*handler)(struct intr_frame *f, int *arg); /* Corresponding handler function */
+    void (*handler)(struct intr_frame *f, int *arg); /* Handler, NULL if not implemented */
+    int arg_count;                                   /* Number of arguments on the user stack */
+    enum syscall_arg_type arg_types[SYSCALL_MAX_ARGS]; /* Pointer-argument metadata */
+    bool pins_own_buffers;                           /* Handler pins its buffers itself (VM) */
 };
 
 /* Syscall initialization */
@@ -49,7 +57,17 @@ int write_to_file(int fd, const void *buffer, unsigned size); // Replaces `write
 void set_file_position(int fd, unsigned position); // Replaces `seek`
 unsigned get_file_position(int fd);              // Replaces `tell`
 void close_file(int fd);                         // Replaces `close`
-void call_syscall_handler(int syscall_code, struct intr_frame *f, int *arg);
+bool change_directory(const char *dirname);      // Replaces `chdir`
+bool make_directory(const char *dirname);        // Replaces `mkdir`
+bool read_directory(int fd, char *name);         // Replaces `readdir`
+bool is_directory(int fd);                       // Replaces `isdir`
+int get_inumber(int fd);                         // Replaces `inumber`
+bool create_pipe(int *fds);                      // Replaces `pipe`
+#ifdef VM
+int map_file(int fd, void *addr);                // Replaces `mmap`
+void unmap_file(int mapid);                      // Replaces `munmap`
+#endif
+const struct syscall_mapping *lookup_syscall(int syscall_code);
 
 //void report_syscall_metrics(int *buffer, int size); // Report syscall usage metrics
 bool is_valid_fd(int fd);  // Validate file descriptor
@@ -59,14 +77,20 @@ void report_syscall_metrics(int *buffer, int size); // Declaration for reporting
 
 
 /* IPC syscall functions */
-void ipc_send_message(const char *message);      // Replaces `ipc_send`
-void ipc_receive_message(char *buffer, size_t size); // Replaces `ipc_receive`
+int ipc_send_message(int channel, const void *message, unsigned size); // Replaces `ipc_send`
+int ipc_receive_message(int channel, void *buffer, unsigned size); // Replaces `ipc_receive`
+int ipc_send_page_message(int channel, void *addr, unsigned page_cnt); // Replaces `ipc_send_pages`
+int ipc_receive_page_message(int channel, void *addr, unsigned page_cnt); // Replaces `ipc_receive_pages`
 
 /* Helper functions (shared across syscall.c and syscall_handlers.c) */
-int convert_user_vaddr(const void *vaddr);       // Replaces `conv_vaddr`
 bool is_valid_pointer(const void *vaddr);        // Replaces `verify_ptr`
-void validate_buffer(void *buffer, unsigned size); // Replaces `verify_buffer`
+void validate_buffer(const void *buffer, unsigned size, bool writable); // Replaces `verify_buffer`
 void validate_string(const void *str);           // Replaces `verify_str`
 
+/* Access to user memory, faulting pages are caught by page_fault() */
+bool copy_from_user(void *dst, const void *usrc, size_t size);
+bool copy_to_user(void *udst, const void *src, size_t size);
+int strncpy_from_user(char *dst, const char *usrc, size_t size);
+
 #endif /* USERPROG_SYSCALL_H */
 
@@ -2,142 +2,197 @@
 #include <syscall-nr.h>
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "userprog/ipc.h"
+#include "userprog/pipe.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 #include <stdio.h>
+#include <string.h>
 
-/* Handle system calls with one argument */
+/* Syscall handlers.  Pointer arguments have already been checked
+   by the dispatcher in syscall.c according to the table below. */
 
-void syscall_exit(struct intr_frame *f, int *arg) {
-    terminate_process(arg[0]); // Renamed function
+static void syscall_halt(struct intr_frame *f UNUSED, int *arg UNUSED) {
+    halt_system();
 }
 
-void syscall_exec(struct intr_frame *f, int *arg) {
-    validate_string((const void *)arg[0]); // Renamed from `verify_str`
-    arg[0] = convert_user_vaddr((const void *)arg[0]); // Renamed from `conv_vaddr`
-    f->eax = execute_program((const char *)arg[0]); // Renamed from `exec`
+static void syscall_exit(struct intr_frame *f UNUSED, int *arg) {
+    terminate_process(arg[0]);
 }
 
-void syscall_wait(struct intr_frame *f, int *arg) {
-    f->eax = wait_for_program(arg[0]); // Renamed from `wait`
+static void syscall_exec(struct intr_frame *f, int *arg) {
+    /* process_execute() tokenizes the command line in place, so hand
+       it a kernel copy rather than the user's string */
+    char *cmd_line = palloc_get_page(0);
+    if (cmd_line == NULL) {
+        f->eax = ERROR;
+        return;
+    }
+    int len = strncpy_from_user(cmd_line, (const char *)arg[0], PGSIZE);
+    if (len < 0 || len >= PGSIZE)
+        f->eax = ERROR;
+    else
+        f->eax = execute_program(cmd_line);
+    palloc_free_page(cmd_line);
 }
 
-void syscall_open(struct intr_frame *f, int *arg) {
-    validate_string((const void *)arg[0]); // Renamed from `verify_str`
-    arg[0] = convert_user_vaddr((const void *)arg[0]); // Renamed from `conv_vaddr`
-    f->eax = open_file((const char *)arg[0]); // Renamed from `open`
+static void syscall_wait(struct intr_frame *f, int *arg) {
+    f->eax = wait_for_program(arg[0]);
 }
 
-void syscall_filesize(struct intr_frame *f, int *arg) {
-    f->eax = get_file_size(arg[0]); // Renamed from `filesize`
+static void syscall_create(struct intr_frame *f, int *arg) {
+    f->eax = create_file((const char *)arg[0], (unsigned)arg[1]);
 }
 
-void syscall_tell(struct intr_frame *f, int *arg) {
-    f->eax = get_file_position(arg[0]); // Renamed from `tell`
+static void syscall_remove(struct intr_frame *f, int *arg) {
+    f->eax = delete_file((const char *)arg[0]);
 }
 
-void syscall_close(struct intr_frame *f, int *arg) {
-    close_file(arg[0]); // Renamed from `close`
+static void syscall_open(struct intr_frame *f, int *arg) {
+    f->eax = open_file((const char *)arg[0]);
 }
 
-void syscall_create(struct intr_frame *f, int *arg) {
-    validate_string((const void *)arg[0]); // Renamed from `verify_str`
-    arg[0] = convert_user_vaddr((const void *)arg[0]); // Renamed from `conv_vaddr`
-    f->eax = create_file((const char *)arg[0], (unsigned)arg[1]); // Renamed from `create`
+static void syscall_filesize(struct intr_frame *f, int *arg) {
+    f->eax = get_file_size(arg[0]);
 }
 
-void syscall_seek(struct intr_frame *f, int *arg) {
-    set_file_position(arg[0], (unsigned)arg[1]); // Renamed from `seek`
+static void syscall_read(struct intr_frame *f, int *arg) {
+    f->eax = read_from_file(arg[0], (void *)arg[1], (unsigned)arg[2]);
 }
 
-void syscall_read(struct intr_frame *f, int *arg) {
-    validate_buffer((void *)arg[1], (unsigned)arg[2]); // Renamed from `verify_buffer`
-    arg[1] = convert_user_vaddr((const void *)arg[1]); // Renamed from `conv_vaddr`
-    f->eax = read_from_file(arg[0], (void *)arg[1], (unsigned)arg[2]); // Renamed from `read`
+static void syscall_write(struct intr_frame *f, int *arg) {
+    f->eax = write_to_file(arg[0], (const void *)arg[1], (unsigned)arg[2]);
 }
 
-void syscall_write(struct intr_frame *f, int *arg) {
-    validate_buffer((void *)arg[1], (unsigned)arg[2]); // Renamed from `verify_buffer`
-    arg[1] = convert_user_vaddr((const void *)arg[1]); // Renamed from `conv_vaddr`
-    f->eax = write_to_file(arg[0], (const void *)arg[1], (unsigned)arg[2]); // Renamed from `write`
+static void syscall_seek(struct intr_frame *f UNUSED, int *arg) {
+    set_file_position(arg[0], (unsigned)arg[1]);
 }
 
-static const struct syscall_mapping syscall_map[] = {
-    {SYS_EXIT, syscall_exit},
-    {SYS_EXEC, syscall_exec},
-    {SYS_WAIT, syscall_wait},
-    {SYS_CREATE, syscall_create},
-    {SYS_OPEN, syscall_open},
-    {SYS_FILESIZE, syscall_filesize},
-    {SYS_TELL, syscall_tell},
-    {SYS_CLOSE, syscall_close},
-    {SYS_SEEK, syscall_seek},
-    {SYS_READ, syscall_read},
-    {SYS_WRITE, syscall_write},
-    // Add more syscalls as needed.
-};
-void call_syscall_handler(int syscall_code, struct intr_frame *f, int *arg) {
-    size_t num_syscalls = sizeof(syscall_map) / sizeof(syscall_map[0]);
-    for (size_t i = 0; i < num_syscalls; i++) {
-        if (syscall_map[i].syscall_code == syscall_code) {
-            syscall_map[i].handler(f, arg);
-            return;
-        }
-    }
-    terminate_process(ERROR);  // Exit if the syscall code is invalid.
+static void syscall_tell(struct intr_frame *f, int *arg) {
+    f->eax = get_file_position(arg[0]);
 }
-static void syscall_handler(struct intr_frame *f) {
-    int arg[3];
-    int esp = (int)f->esp;
-    verify_ptr((const void *)esp);
 
-    int syscall_code = *(int *)esp;
-    int number_of_arg = number_of_args(syscall_code);
+static void syscall_close(struct intr_frame *f UNUSED, int *arg) {
+    close_file(arg[0]);
+}
 
-    load_arg(f, arg, number_of_arg);
-    call_syscall_handler(syscall_code, f, arg);
+static void syscall_chdir(struct intr_frame *f, int *arg) {
+    f->eax = change_directory((const char *)arg[0]);
 }
 
+static void syscall_mkdir(struct intr_frame *f, int *arg) {
+    f->eax = make_directory((const char *)arg[0]);
+}
 
-// names changed
-#define ERROR -1
-#define STDIN  0
-#define STDOUT 1
+static void syscall_readdir(struct intr_frame *f, int *arg) {
+    f->eax = read_directory(arg[0], (char *)arg[1]);
+}
 
-/* Helper functions */
-static struct file *fetch_file_with_lock(int fd, struct thread *cur_thread) {
-    struct file *file_ptr = current_process_get_file(fd, cur_thread);
-    if (file_ptr != NULL) {
-        lock_acquire(&filesys_lock);
-    }
-    return file_ptr;
+static void syscall_isdir(struct intr_frame *f, int *arg) {
+    f->eax = is_directory(arg[0]);
 }
 
-static void unlock_file_lock() {
-    lock_release(&filesys_lock);
+static void syscall_inumber(struct intr_frame *f, int *arg) {
+    f->eax = get_inumber(arg[0]);
 }
 
-static int perform_file_operation(struct file *file_ptr, int (*operation)(struct file *, const void *, unsigned),
-                                 const void *buffer, unsigned size) {
-    if (file_ptr == NULL) return ERROR;
-    lock_acquire(&filesys_lock);
-    int result = operation(file_ptr, buffer, size);
-    lock_release(&filesys_lock);
-    return result;
+static void syscall_pipe(struct intr_frame *f, int *arg) {
+    f->eax = create_pipe((int *)arg[0]);
 }
 
-static bool execute_file_action(struct file *file_ptr, void (*action)(struct file *)) {
-    if (file_ptr == NULL) return false;
-    lock_acquire(&filesys_lock);
-    action(file_ptr);
-    lock_release(&filesys_lock);
-    return true;
+static void syscall_ipc_send(struct intr_frame *f, int *arg) {
+    f->eax = ipc_send_message(arg[0], (const void *)arg[1], (unsigned)arg[2]);
+}
+
+static void syscall_ipc_receive(struct intr_frame *f, int *arg) {
+    f->eax = ipc_receive_message(arg[0], (void *)arg[1], (unsigned)arg[2]);
+}
+
+static void syscall_ipc_send_pages(struct intr_frame *f, int *arg) {
+    f->eax = ipc_send_page_message(arg[0], (void *)arg[1], (unsigned)arg[2]);
 }
 
+static void syscall_ipc_receive_pages(struct intr_frame *f, int *arg) {
+    f->eax = ipc_receive_page_message(arg[0], (void *)arg[1], (unsigned)arg[2]);
+}
+
+#ifdef VM
+static void syscall_mmap(struct intr_frame *f, int *arg) {
+    f->eax = map_file(arg[0], (void *)arg[1]);
+}
+
+static void syscall_munmap(struct intr_frame *f UNUSED, int *arg) {
+    unmap_file(arg[0]);
+}
+#endif
+
+/* Syscall table, indexed directly by syscall code.  Codes without
+   an entry have a null handler and kill the caller. */
+static const struct syscall_mapping syscall_map[] = {
+    [SYS_HALT]     = {syscall_halt,     0, {ARG_VALUE}},
+    [SYS_EXIT]     = {syscall_exit,     1, {ARG_VALUE}},
+    [SYS_EXEC]     = {syscall_exec,     1, {ARG_STRING}},
+    [SYS_WAIT]     = {syscall_wait,     1, {ARG_VALUE}},
+    [SYS_CREATE]   = {syscall_create,   2, {ARG_STRING, ARG_VALUE}},
+    [SYS_REMOVE]   = {syscall_remove,   1, {ARG_STRING}},
+    [SYS_OPEN]     = {syscall_open,     1, {ARG_STRING}},
+    [SYS_FILESIZE] = {syscall_filesize, 1, {ARG_VALUE}},
+    /* Reads and writes can block on a pipe or the keyboard, so they
+       pin their buffers only around file and console I/O */
+    [SYS_READ]     = {syscall_read,     3, {ARG_VALUE, ARG_OUT_BUFFER, ARG_VALUE}, true},
+    [SYS_WRITE]    = {syscall_write,    3, {ARG_VALUE, ARG_IN_BUFFER, ARG_VALUE}, true},
+    [SYS_SEEK]     = {syscall_seek,     2, {ARG_VALUE, ARG_VALUE}},
+    [SYS_TELL]     = {syscall_tell,     1, {ARG_VALUE}},
+    [SYS_CLOSE]    = {syscall_close,    1, {ARG_VALUE}},
+#ifdef VM
+    /* The address passed to mmap is where to map, so it is not checked */
+    [SYS_MMAP]     = {syscall_mmap,     2, {ARG_VALUE, ARG_VALUE}},
+    [SYS_MUNMAP]   = {syscall_munmap,   1, {ARG_VALUE}},
+#endif
+    [SYS_CHDIR]    = {syscall_chdir,    1, {ARG_STRING}},
+    [SYS_MKDIR]    = {syscall_mkdir,    1, {ARG_STRING}},
+    /* The name buffer has a fixed size, so read_directory() checks it */
+    [SYS_READDIR]  = {syscall_readdir,  2, {ARG_VALUE, ARG_VALUE}},
+    [SYS_ISDIR]    = {syscall_isdir,    1, {ARG_VALUE}},
+    [SYS_INUMBER]  = {syscall_inumber,  1, {ARG_VALUE}},
+    /* The descriptor array has a fixed size, so create_pipe() checks it */
+    [SYS_PIPE]     = {syscall_pipe,     1, {ARG_VALUE}},
+    /* Sends and receives block, so messages go through a kernel
+       buffer and the handlers check the user buffers themselves */
+    [SYS_IPC_SEND]    = {syscall_ipc_send,    3, {ARG_VALUE, ARG_VALUE, ARG_VALUE}},
+    [SYS_IPC_RECEIVE] = {syscall_ipc_receive, 3, {ARG_VALUE, ARG_VALUE, ARG_VALUE}},
+    /* Whole pages change hands, so ipc.c checks the ranges itself */
+    [SYS_IPC_SEND_PAGES]    = {syscall_ipc_send_pages,    3, {ARG_VALUE, ARG_VALUE, ARG_VALUE}},
+    [SYS_IPC_RECEIVE_PAGES] = {syscall_ipc_receive_pages, 3, {ARG_VALUE, ARG_VALUE, ARG_VALUE}},
+};
+
+/* Returns the table entry for SYSCALL_CODE, or a null pointer if
+   there is no handler for it. */
+const struct syscall_mapping *lookup_syscall(int syscall_code) {
+    size_t num_syscalls = sizeof(syscall_map) / sizeof(syscall_map[0]);
+    if (syscall_code < 0 || (size_t)syscall_code >= num_syscalls
+        || syscall_map[syscall_code].handler == NULL)
+        return NULL;
+    return &syscall_map[syscall_code];
+}
+
+
+// names changed
+#define ERROR -1
+#define STDIN  0
+#define STDOUT 1
+
 /* Refactored system call functions */
 void halt_system(void) {
     shutdown_power_off();
@@ -173,36 +228,85 @@ int wait_for_program(pid_t process_id) {
     return process_wait(process_id);
 }
 
+/* The file system does its own locking (per inode, per directory
+   and for the free map), so none of these take a global lock. */
 bool create_file(const char *filename, unsigned initial_size) {
-    lock_acquire(&filesys_lock);
-    bool success = filesys_create(filename, initial_size);
-    lock_release(&filesys_lock);
-    return success;
+    return filesys_create(filename, initial_size);
 }
 
 bool delete_file(const char *filename) {
-    lock_acquire(&filesys_lock);
-    bool success = filesys_remove(filename);
-    lock_release(&filesys_lock);
-    return success;
+    return filesys_remove(filename);
 }
 
 int open_file(const char *filename) {
-    lock_acquire(&filesys_lock);
     struct file *file_ptr = filesys_open(filename);
-    int result = (file_ptr != NULL) ?current_process_add_file(file_ptr, thread_current()) : ERROR;
-    lock_release(&filesys_lock);
-    return result;
+    return (file_ptr != NULL) ? current_process_add_file(file_ptr, thread_current()) : ERROR;
 }
 
 int get_file_size(int fd) {
-    struct thread *current_thread = thread_current();
-    struct file *file_ptr = fetch_file_with_lock(fd, current_thread);
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
     if (file_ptr == NULL) return ERROR;
+    return file_length(file_ptr);
+}
+
+/* Pin the SIZE bytes of user memory at BUFFER for the file system,
+   which accesses them with inode locks held; see pin_buffer_args()
+   in syscall.c.  Does nothing without VM. */
+static void pin_user_buffer(const void *buffer, unsigned size) {
+#ifdef VM
+    if (!page_pin_range(buffer, size)) terminate_process(ERROR);
+#else
+    (void)buffer;
+    (void)size;
+#endif
+}
+
+/* Undo pin_user_buffer(BUFFER, SIZE). */
+static void unpin_user_buffer(const void *buffer, unsigned size) {
+#ifdef VM
+    page_unpin_range(buffer, size);
+#else
+    (void)buffer;
+    (void)size;
+#endif
+}
+
+/* Read up to SIZE bytes from PIPE into user BUFFER.  The data goes
+   through a kernel page, so the user buffer is neither pinned nor
+   touched while the reader waits for a writer. */
+static int read_from_pipe(struct pipe *pipe, void *buffer, unsigned size) {
+    if (size == 0) return 0;
+    void *kbuf = palloc_get_page(0);
+    if (kbuf == NULL) return ERROR;
+
+    int bytes_read = pipe_read(pipe, kbuf, size < PGSIZE ? size : PGSIZE);
+    bool ok = copy_to_user(buffer, kbuf, bytes_read);
+    palloc_free_page(kbuf);
+    if (!ok) terminate_process(ERROR);
+    return bytes_read;
+}
+
+/* Write the SIZE bytes in user BUFFER to PIPE, a page at a time
+   through a kernel page; see read_from_pipe(). */
+static int write_to_pipe(struct pipe *pipe, const void *buffer, unsigned size) {
+    if (size == 0) return 0;
+    void *kbuf = palloc_get_page(0);
+    if (kbuf == NULL) return ERROR;
 
-    int length = file_length(file_ptr);
-    unlock_file_lock();
-    return length;
+    unsigned written = 0;
+    while (written < size) {
+        unsigned chunk = size - written < PGSIZE ? size - written : PGSIZE;
+        if (!copy_from_user(kbuf, (const uint8_t *)buffer + written, chunk)) {
+            palloc_free_page(kbuf);
+            terminate_process(ERROR);
+        }
+        int n = pipe_write(pipe, kbuf, chunk);
+        if (n < 0) break;
+        written += n;
+        if ((unsigned)n < chunk) break;
+    }
+    palloc_free_page(kbuf);
+    return written > 0 ? (int)written : ERROR;
 }
 
 int read_from_file(int fd, void *buffer, unsigned size) {
@@ -215,54 +319,132 @@ int read_from_file(int fd, void *buffer, unsigned size) {
         return size;
     }
 
-    struct file *file_ptr = fetch_file_with_lock(fd, current_thread);
-    if (file_ptr == NULL) return ERROR;
+    struct pipe *pipe = current_process_get_pipe(fd, false, current_thread);
+    if (pipe != NULL) return read_from_pipe(pipe, buffer, size);
 
+    struct file *file_ptr = current_process_get_file(fd, current_thread);
+    if (file_ptr == NULL || inode_is_dir(file_get_inode(file_ptr))) return ERROR;
+    pin_user_buffer(buffer, size);
     int bytes_read = file_read(file_ptr, buffer, size);
-    unlock_file_lock();
+    unpin_user_buffer(buffer, size);
     return bytes_read;
 }
 
 int write_to_file(int fd, const void *buffer, unsigned size) {
     struct thread *current_thread = thread_current();
     if (fd == STDOUT) {
+        pin_user_buffer(buffer, size);
         putbuf(buffer, size);
+        unpin_user_buffer(buffer, size);
         return size;
     }
 
-    struct file *file_ptr = fetch_file_with_lock(fd, current_thread);
-    if (file_ptr == NULL) return ERROR;
+    struct pipe *pipe = current_process_get_pipe(fd, true, current_thread);
+    if (pipe != NULL) return write_to_pipe(pipe, buffer, size);
 
+    struct file *file_ptr = current_process_get_file(fd, current_thread);
+    if (file_ptr == NULL || inode_is_dir(file_get_inode(file_ptr))) return ERROR;
+    pin_user_buffer(buffer, size);
     int bytes_written = file_write(file_ptr, buffer, size);
-    unlock_file_lock();
+    unpin_user_buffer(buffer, size);
     return bytes_written;
 }
 
 void set_file_position(int fd, unsigned position) {
-    struct thread *current_thread = thread_current();
-    struct file *file_ptr = fetch_file_with_lock(fd, current_thread);
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
     if (file_ptr != NULL) {
         file_seek(file_ptr, position);
-        unlock_file_lock();
     }
 }
 
 unsigned get_file_position(int fd) {
-    struct thread *current_thread = thread_current();
-    struct file *file_ptr = fetch_file_with_lock(fd, current_thread);
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
     if (file_ptr == NULL) return ERROR;
-
-    unsigned position = file_tell(file_ptr);
-    unlock_file_lock();
-    return position;
+    return file_tell(file_ptr);
 }
 
 void close_file(int fd) {
+    current_process_close_file(fd, thread_current());
+}
+
+bool change_directory(const char *dirname) {
+    return filesys_chdir(dirname);
+}
+
+bool make_directory(const char *dirname) {
+    return filesys_mkdir(dirname);
+}
+
+/* A directory descriptor is an ordinary open file on the
+   directory's inode; its file position is the readdir position. */
+bool read_directory(int fd, char *name) {
+    char kname[NAME_MAX + 1];
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
+    if (file_ptr == NULL || !inode_is_dir(file_get_inode(file_ptr))) return false;
+
+    struct dir *dir = dir_open(inode_reopen(file_get_inode(file_ptr)));
+    if (dir == NULL) return false;
+    dir_seek(dir, file_tell(file_ptr));
+    bool found = dir_readdir(dir, kname);
+    file_seek(file_ptr, dir_tell(dir));
+    dir_close(dir);
+
+    if (found && !copy_to_user(name, kname, strlen(kname) + 1)) {
+        terminate_process(ERROR);
+    }
+    return found;
+}
+
+bool is_directory(int fd) {
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
+    return file_ptr != NULL && inode_is_dir(file_get_inode(file_ptr));
+}
+
+int get_inumber(int fd) {
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
+    if (file_ptr == NULL) return ERROR;
+    return inode_get_inumber(file_get_inode(file_ptr));
+}
+
+/* Creates a pipe and stores its read and write descriptors in
+   FDS[0] and FDS[1].  Pipes live in memory, so unlike files they
+   never touch the disk. */
+bool create_pipe(int *fds) {
     struct thread *current_thread = thread_current();
-    lock_acquire(&filesys_lock);
-    current_process_close_file(fd, current_thread);
-    lock_release(&filesys_lock);
+    struct pipe *pipe = pipe_create();
+    if (pipe == NULL) return false;
+
+    int kfds[2];
+    kfds[0] = current_process_add_pipe(pipe, false, current_thread);
+    if (kfds[0] == ERROR) {
+        pipe_close(pipe, false);
+        pipe_close(pipe, true);
+        return false;
+    }
+    kfds[1] = current_process_add_pipe(pipe, true, current_thread);
+    if (kfds[1] == ERROR) {
+        current_process_close_file(kfds[0], current_thread);
+        pipe_close(pipe, true);
+        return false;
+    }
+
+    if (!copy_to_user(fds, kfds, sizeof kfds)) {
+        terminate_process(ERROR);
+    }
+    return true;
 }
+
+#ifdef VM
+int map_file(int fd, void *addr) {
+    struct file *file_ptr = current_process_get_file(fd, thread_current());
+    if (file_ptr == NULL || inode_is_dir(file_get_inode(file_ptr))) return MAP_FAILED;
+    return mmap_map(file_ptr, addr);
+}
+
+void unmap_file(int mapid) {
+    mmap_unmap(mapid);
+}
+#endif
 int syscall_usage_count[20] = {0};
 
 static void track_syscall_usage(int syscall_code) {
@@ -292,24 +474,40 @@ bool is_valid_pid(pid_t pid) {
 }
 
 
-void ipc_send_message(const char *message) {
-    sema_down(&shared_ipc_buffer.sema);
-    size_t i = 0;
-    while (i < IPC_BUFFER_SIZE - 1 && message[i] != '\0') {
-        shared_ipc_buffer.data[i] = message[i];
-        i++;
+/* Channels hold their own copy of each message, so the user
+   buffers are never touched with a channel lock held */
+/* The message is copied in before ipc_send() can block on a full
+   channel, so nothing in user memory is pinned while it waits. */
+int ipc_send_message(int channel, const void *message, unsigned size) {
+    char kmessage[IPC_MESSAGE_MAX];
+
+    if (size > IPC_MESSAGE_MAX) return ERROR;
+    if (!copy_from_user(kmessage, message, size)) {
+        terminate_process(ERROR);
     }
-    shared_ipc_buffer.data[i] = '\0';
-    sema_up(&shared_ipc_buffer.sema);
+    return ipc_send(channel, kmessage, size) ? (int)size : ERROR;
 }
 
-void ipc_receive_message(char *buffer, size_t size) {
-    sema_down(&shared_ipc_buffer.sema);
-    size_t i = 0;
-    while (i < size - 1 && shared_ipc_buffer.data[i] != '\0') {
-        buffer[i] = shared_ipc_buffer.data[i];
-        i++;
+/* The message is copied out only after ipc_receive() has stopped
+   waiting for it; see ipc_send_message().  The buffer is still
+   checked first, so that a bad one does not lose a message. */
+int ipc_receive_message(int channel, void *buffer, unsigned size) {
+    char kbuffer[IPC_MESSAGE_MAX];
+
+    /* Kill the caller for a bad buffer before a message is lost */
+    validate_buffer(buffer, size, true);
+    int received = ipc_receive(channel, kbuffer,
+                               size < IPC_MESSAGE_MAX ? size : IPC_MESSAGE_MAX);
+    if (received > 0 && !copy_to_user(buffer, kbuffer, received)) {
+        terminate_process(ERROR);
     }
-    buffer[i] = '\0';
-    sema_up(&shared_ipc_buffer.sema);
+    return received;
+}
+
+int ipc_send_page_message(int channel, void *addr, unsigned page_cnt) {
+    return ipc_send_pages(channel, addr, page_cnt) ? (int)page_cnt : ERROR;
+}
+
+int ipc_receive_page_message(int channel, void *addr, unsigned page_cnt) {
+    return ipc_receive_pages(channel, addr, page_cnt);
 }
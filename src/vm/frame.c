@@ -0,0 +1,218 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/share.h"
+
+/* Every frame handed out from the user pool, in allocation
+   order.  Eviction sweeps it like the hand of a clock, giving
+   each recently accessed frame a second chance. */
+static struct list frames;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;  /* Protects frames and clock_hand. */
+
+static struct frame *evict (void);
+static struct frame *choose_victim (void);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  clock_hand = list_end (&frames);
+  lock_init (&frame_lock);
+}
+
+/* Allocates a frame from the user pool to hold PAGE, evicting
+   some other page if the pool is exhausted.  A null PAGE makes a
+   frame that is never evicted, unless it is later passed to
+   frame_set_shared().  The frame is returned pinned;
+   the caller unpins it once it has been filled and mapped.
+   Returns a null pointer if no frame can be found. */
+struct frame *
+frame_alloc (struct page *page)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          return NULL;
+        }
+      f->kpage = kpage;
+      lock_acquire (&frame_lock);
+      list_push_back (&frames, &f->elem);
+    }
+  else
+    {
+      f = evict ();
+      if (f == NULL)
+        return NULL;
+      lock_acquire (&frame_lock);
+    }
+  f->page = page;
+  f->shared = NULL;
+  f->pinned = true;
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Removes F from the frame table and returns its memory to the
+   user pool.  F must no longer be mapped by any process. */
+void
+frame_free (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Prevents F from being evicted until frame_unpin(). */
+void
+frame_pin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pinned = true;
+  lock_release (&frame_lock);
+}
+
+/* Makes F eligible for eviction again. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pinned = false;
+  lock_release (&frame_lock);
+}
+
+/* Makes F hold PAGE, or, if PAGE is null, makes it a frame that
+   is never evicted, as for frame_alloc(). */
+void
+frame_set_page (struct frame *f, struct page *page)
+{
+  lock_acquire (&frame_lock);
+  f->page = page;
+  lock_release (&frame_lock);
+}
+
+/* Makes F, which must have been allocated with a null page, hold
+   shared page S, so that it can be evicted through S's sharers. */
+void
+frame_set_shared (struct frame *f, struct shared_page *s)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->page == NULL);
+  f->shared = s;
+  lock_release (&frame_lock);
+}
+
+/* Evicts the page in some frame and returns that frame, pinned.
+   Returns a null pointer if every frame is pinned, unevictable,
+   or holds a page that cannot be written out. */
+static struct frame *
+evict (void)
+{
+  size_t tries;
+
+  lock_acquire (&frame_lock);
+  tries = list_size (&frames);
+  lock_release (&frame_lock);
+
+  while (tries-- > 0)
+    {
+      struct frame *f;
+      struct page *victim;
+      bool evicted;
+
+      lock_acquire (&frame_lock);
+      f = choose_victim ();
+      lock_release (&frame_lock);
+      if (f == NULL)
+        return NULL;
+
+      /* A shared frame is clean, so it only has to be unmapped. */
+      if (f->shared != NULL)
+        {
+          share_evict (f->shared);
+          return f;
+        }
+
+      /* choose_victim() returned with the victim's page locked, so
+         its owner cannot fault it back in or free it under us. */
+      victim = f->page;
+      evicted = page_evict (victim);
+      lock_release (&victim->lock);
+      if (evicted)
+        return f;
+      frame_unpin (f);
+    }
+  return NULL;
+}
+
+/* Sweeps the clock hand around the frame table, clearing
+   accessed bits as it goes, until it finds an evictable frame
+   whose page has not been accessed since the last sweep.  Pins
+   that frame, locks its page and returns it.  For a shared frame,
+   share_lock_victim() does the checking and locking instead.  Gives up after two
+   full turns and returns a null pointer.
+   Must be called with frame_lock held. */
+static struct frame *
+choose_victim (void)
+{
+  size_t n = 2 * list_size (&frames);
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  while (n-- > 0)
+    {
+      struct frame *f;
+      struct page *p;
+      uint32_t *pd;
+
+      if (clock_hand == list_end (&frames))
+        clock_hand = list_begin (&frames);
+      f = list_entry (clock_hand, struct frame, elem);
+      clock_hand = list_next (clock_hand);
+
+      if (f->pinned)
+        continue;
+      if (f->shared != NULL)
+        {
+          if (share_lock_victim (f->shared))
+            {
+              f->pinned = true;
+              return f;
+            }
+          continue;
+        }
+
+      p = f->page;
+      if (p == NULL)
+        continue;
+
+      pd = p->thread->pagedir;
+      if (pagedir_is_accessed (pd, p->upage))
+        pagedir_set_accessed (pd, p->upage, false);
+      else if (!lock_held_by_current_thread (&p->lock)
+               && lock_try_acquire (&p->lock))
+        {
+          f->pinned = true;
+          return f;
+        }
+    }
+  return NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct page;
+struct shared_page;
+
+/* A frame of physical memory from the user pool. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct page *page;          /* Page it holds, or null if it is
+                                   shared or may not be evicted. */
+    struct shared_page *shared; /* Shared page it holds, or null. */
+    bool pinned;                /* Exempt from eviction for now? */
+    struct list_elem elem;      /* Element in frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+void frame_free (struct frame *);
+void frame_pin (struct frame *);
+void frame_unpin (struct frame *);
+void frame_set_page (struct frame *, struct page *);
+void frame_set_shared (struct frame *, struct shared_page *);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,134 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* A file mapped into a process's address space.
+
+   Each page of the mapping is a supplemental page table entry
+   that is read from the file when first touched and written back
+   to it, if modified, when evicted or unmapped. */
+struct mapping
+  {
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* Our own handle on the file. */
+    uint8_t *base;              /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+    struct list_elem elem;      /* Element in thread's mappings. */
+  };
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process's address space at ADDR,
+   which must be page-aligned and nonnull.  The last page is
+   padded with zeros, which are never written back.  Returns the
+   new mapping's identifier, or MAP_FAILED if FILE is empty or the
+   pages would overlap anything already mapped or the range
+   reserved for the stack. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  uint8_t *base = addr;
+  off_t length;
+  size_t i;
+
+  if (base == NULL || pg_ofs (base) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->base = base;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (base >= (uint8_t *) PHYS_BASE - STACK_MAX
+      || m->page_cnt > (size_t) ((uint8_t *) PHYS_BASE - STACK_MAX - base)
+                       / PGSIZE)
+    goto fail;
+  for (i = 0; i < m->page_cnt; i++)
+    if (page_lookup (base + i * PGSIZE) != NULL)
+      goto fail;
+
+  /* Keep the file open past a close() of the descriptor. */
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    goto fail;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap (m->file, ofs, base + ofs, read_bytes))
+        {
+          m->page_cnt = i;
+          unmap (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+
+ fail:
+  free (m);
+  return MAP_FAILED;
+}
+
+/* Unmaps the current process's mapping MAPID, writing back its
+   modified pages.  Does nothing if there is no such mapping. */
+void
+mmap_unmap (int mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of the current process's mappings, writing back
+   their modified pages. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    {
+      struct list_elem *e = list_pop_front (&t->mappings);
+      unmap (list_entry (e, struct mapping, elem));
+    }
+}
+
+/* Removes M's pages, closes its file and frees it. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->base + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,489 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+
+static bool load_page (struct page *);
+static void unpin_page (struct page *);
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Creates an empty supplemental page table for T.
+   Returns true if successful, false if out of memory. */
+bool
+page_table_init (struct thread *t)
+{
+  ASSERT (t->pages == NULL);
+
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Writes the first READ_BYTES bytes of memory-mapped page P,
+   which must be locked and in a frame, back to its file. */
+static void
+write_back (struct page *p)
+{
+  ASSERT (p->mmapped);
+  file_write_at (p->file, p->frame->kpage, p->read_bytes, p->file_ofs);
+}
+
+/* Unmaps page P, writes it back to its file if it is a modified
+   memory-mapped page, gives up its frame and swap slot, and
+   frees it.  Waits for any eviction of P in progress to finish
+   first. */
+static void
+page_destroy (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+  uint32_t *pd = p->thread->pagedir;
+
+  lock_acquire (&p->lock);
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (pd, p->upage);
+      if (p->mmapped && pagedir_is_dirty (pd, p->upage))
+        write_back (p);
+      if (p->shared != NULL)
+        share_put (p);
+      else
+        frame_free (p->frame);
+    }
+  if (p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  lock_release (&p->lock);
+  free (p);
+}
+
+/* Destroys T's supplemental page table, if it has one.  Must be
+   called before T's page directory is destroyed, and while the
+   files backing its pages are still open.  Afterward no user
+   page is left mapped, so pagedir_destroy() frees no frames. */
+void
+page_table_destroy (struct thread *t)
+{
+  if (t->pages == NULL)
+    return;
+  hash_destroy (t->pages, page_destroy);
+  free (t->pages);
+  t->pages = NULL;
+}
+
+/* Adds P to the current thread's page table.  Returns false, and
+   frees P, if a page at that address is already present. */
+static bool
+insert_page (struct page *p)
+{
+  if (hash_insert (thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  return true;
+}
+
+/* Creates a page for UPAGE in the current process's page table,
+   with the given initial contents, and returns it.  Returns a
+   null pointer if out of memory or UPAGE is already in use. */
+static struct page *
+add_page (struct file *file, off_t ofs, void *upage,
+          uint32_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->writable = writable;
+  p->thread = thread_current ();
+  p->frame = NULL;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->mmapped = false;
+  p->swap_slot = SWAP_ERROR;
+  p->shared = NULL;
+  p->pinned = false;
+  lock_init (&p->lock);
+  return insert_page (p) ? p : NULL;
+}
+
+/* Records that user page UPAGE of the current process is to be
+   filled with READ_BYTES bytes of FILE starting at offset OFS,
+   followed by zeros, when it is first touched.  FILE must stay
+   open for as long as the page exists.
+   Returns true if successful, false if out of memory or UPAGE is
+   already in use. */
+bool
+page_add_file (struct file *file, off_t ofs, void *upage,
+               uint32_t read_bytes, bool writable)
+{
+  return add_page (file, ofs, upage, read_bytes, writable) != NULL;
+}
+
+/* Records that user page UPAGE of the current process is to be
+   zero-filled when it is first touched.  Returns true if
+   successful, false if out of memory or UPAGE is already in
+   use. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add_file (NULL, 0, upage, 0, writable);
+}
+
+/* Records that user page UPAGE of the current process maps the
+   READ_BYTES bytes of FILE starting at offset OFS, followed by
+   zeros.  Unlike page_add_file(), modifications are written back
+   to FILE rather than to swap.  FILE must stay open for as long
+   as the page exists.  Returns true if successful, false if out
+   of memory or UPAGE is already in use. */
+bool
+page_add_mmap (struct file *file, off_t ofs, void *upage,
+               uint32_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0);
+
+  p = add_page (file, ofs, upage, read_bytes, true);
+  if (p == NULL)
+    return false;
+  p->mmapped = true;
+  return true;
+}
+
+/* Removes the current process's page at UPAGE, as by
+   page_table_destroy().  Does nothing if there is no such
+   page. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  if (p != NULL)
+    {
+      hash_delete (thread_current ()->pages, &p->hash_elem);
+      page_destroy (&p->hash_elem, NULL);
+    }
+}
+
+/* Returns the current process's page containing user virtual
+   address UADDR, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Brings the page containing UADDR into memory and maps it into
+   the current process's page directory.  Returns true if
+   successful, false if UADDR is not part of any page of the
+   process or if memory or the disk fails us. */
+bool
+page_load (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+  bool success;
+
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->lock);
+  success = p->frame == NULL && load_page (p);
+  if (success)
+    unpin_page (p);
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Unpins P, which must be locked and in memory. */
+static void
+unpin_page (struct page *p)
+{
+  if (p->shared != NULL)
+    share_unpin (p);
+  else
+    frame_unpin (p->frame);
+}
+
+/* Extends the current process's stack down to the page containing
+   UADDR, if UADDR looks like a stack access: it must lie within
+   STACK_MAX bytes of the top of user memory, and no more than 32
+   bytes below ESP, the process's user stack pointer, since PUSHA
+   checks access 32 bytes below the stack pointer before moving it.
+   A null ESP means the process has not run yet and its initial
+   stack is still being built, so only the first test applies.
+   Returns true if the page was added and loaded. */
+bool
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  const uint8_t *addr = uaddr;
+
+  if (!is_user_vaddr (addr) || addr < (uint8_t *) PHYS_BASE - STACK_MAX)
+    return false;
+  if (esp != NULL && addr < (const uint8_t *) esp - 32)
+    return false;
+  return page_add_zero (pg_round_down (addr), true) && page_load (addr);
+}
+
+/* Loads page P, which must be locked and not in memory, into a
+   frame and maps it.  The frame is left pinned.  Returns true if
+   successful, false on failure. */
+static bool
+load_page (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->frame == NULL);
+
+  /* Read-only pages of a file are the same in every process that
+     maps them, so map the copy already in memory, if any. */
+  if (!p->writable && p->file != NULL)
+    {
+      f = share_get (p);
+      if (f == NULL)
+        return false;
+      if (!pagedir_set_page (pd, p->upage, f->kpage, false))
+        {
+          share_put (p);
+          return false;
+        }
+      p->frame = f;
+      share_pin (p);
+      return true;
+    }
+
+  f = frame_alloc (p);
+  if (f == NULL)
+    return false;
+  if (!pagedir_set_page (pd, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+
+  if (p->swap_slot != SWAP_ERROR)
+    {
+      /* The copy in swap was the only one, so the page has to be
+         written out again if it is evicted again. */
+      swap_in (p->swap_slot, f->kpage);
+      p->swap_slot = SWAP_ERROR;
+      pagedir_set_dirty (pd, p->upage, true);
+    }
+  else
+    {
+      if (p->file != NULL
+          && file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs)
+             != (off_t) p->read_bytes)
+        {
+          pagedir_clear_page (pd, p->upage);
+          frame_free (f);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+    }
+  p->frame = f;
+  return true;
+}
+
+/* Evicts page P, which must be locked and in a pinned frame:
+   unmaps it and, if it was modified, writes it back to its file
+   (for a memory-mapped page) or to swap, so that its frame can
+   be reused.  Returns false, leaving P mapped, if P has to go to
+   swap and swap is full. */
+bool
+page_evict (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->frame != NULL && p->shared == NULL);
+
+  /* Unmap first, so that the owner cannot dirty the page after we
+     have looked at the dirty bit. */
+  pagedir_clear_page (pd, p->upage);
+  if (p->mmapped)
+    {
+      if (pagedir_is_dirty (pd, p->upage))
+        write_back (p);
+    }
+  else if (pagedir_is_dirty (pd, p->upage))
+    {
+      size_t slot = swap_out (p->frame->kpage);
+      if (slot == SWAP_ERROR)
+        {
+          pagedir_set_page (pd, p->upage, p->frame->kpage, p->writable);
+          pagedir_set_dirty (pd, p->upage, true);
+          return false;
+        }
+      p->swap_slot = slot;
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Takes the current process's page at UPAGE out of its address
+   space, so that its frame can be handed to another process with
+   page_attach() without copying.  Only private, writable pages
+   qualify: not memory-mapped and not shared.  The page is
+   brought into memory first if necessary.  Returns its frame,
+   pinned and holding no page, or a null pointer if UPAGE does not
+   qualify or cannot be brought in. */
+struct frame *
+page_detach (void *upage)
+{
+  struct page *p = page_lookup (upage);
+  struct frame *f;
+
+  if (p == NULL || pg_ofs (upage) != 0 || !p->writable || p->mmapped
+      || p->shared != NULL)
+    return NULL;
+
+  lock_acquire (&p->lock);
+  if (p->frame == NULL)
+    {
+      if (!load_page (p))
+        {
+          lock_release (&p->lock);
+          return NULL;
+        }
+    }
+  else
+    frame_pin (p->frame);
+  f = p->frame;
+  pagedir_clear_page (p->thread->pagedir, p->upage);
+  frame_set_page (f, NULL);
+  p->frame = NULL;
+  lock_release (&p->lock);
+
+  /* P now has neither a frame nor a swap slot. */
+  page_remove (upage);
+  return f;
+}
+
+/* Maps frame F, obtained from page_detach(), at UPAGE in the
+   current process as a private, writable page, and unpins it.
+   Returns false, leaving F alone, if UPAGE is already in use or
+   memory is short. */
+bool
+page_attach (void *upage, struct frame *f)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct page *p;
+
+  p = add_page (NULL, 0, upage, 0, true);
+  if (p == NULL)
+    return false;
+  if (!pagedir_set_page (pd, upage, f->kpage, true))
+    {
+      page_remove (upage);
+      return false;
+    }
+
+  /* The frame holds the only copy, so it has to go to swap if it
+     is evicted. */
+  pagedir_set_dirty (pd, upage, true);
+  lock_acquire (&p->lock);
+  p->frame = f;
+  frame_set_page (f, p);
+  frame_unpin (f);
+  lock_release (&p->lock);
+  return true;
+}
+
+/* Brings every page in the SIZE bytes of user memory at UADDR
+   into memory and pins it there until page_unpin_range(), so
+   that the kernel can access the range while holding locks that
+   page_load() might need.  Returns false if a page could not be
+   brought in; pages pinned so far stay pinned until the process
+   exits. */
+bool
+page_pin_range (const void *uaddr, size_t size)
+{
+  const uint8_t *p = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  bool success = true;
+
+  for (; size > 0 && success && p < end; p += PGSIZE)
+    {
+      struct page *page = page_lookup (p);
+      if (page == NULL)
+        continue;
+
+      lock_acquire (&page->lock);
+      if (page->frame == NULL)
+        success = load_page (page);
+      else if (page->shared != NULL)
+        share_pin (page);
+      else
+        frame_pin (page->frame);
+      lock_release (&page->lock);
+    }
+  return success;
+}
+
+/* Unpins the pages pinned by page_pin_range(UADDR, SIZE). */
+void
+page_unpin_range (const void *uaddr, size_t size)
+{
+  const uint8_t *p = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+
+  for (; size > 0 && p < end; p += PGSIZE)
+    {
+      struct page *page = page_lookup (p);
+      if (page != NULL)
+        {
+          lock_acquire (&page->lock);
+          if (page->frame != NULL)
+            unpin_page (page);
+          lock_release (&page->lock);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+/* Largest size of a user stack, in bytes. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+struct file;
+struct frame;
+struct shared_page;
+struct thread;
+
+/* Supplemental page table entry.
+
+   Records, for one page of a process's user virtual address
+   space, where its contents come from, so that the page can be
+   brought in on first access instead of when the process
+   starts, and brought back in after it has been evicted. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    bool writable;              /* May the process write to it? */
+    struct thread *thread;      /* Process that owns the page. */
+    struct frame *frame;        /* Frame holding it, or null. */
+
+    /* Initial contents: READ_BYTES bytes from FILE at FILE_OFS,
+       then zeros to the end of the page.  A null FILE means an
+       all-zero page. */
+    struct file *file;
+    off_t file_ofs;
+    uint32_t read_bytes;
+    bool mmapped;               /* Write back to FILE, not to swap? */
+
+    /* Swap slot holding the page while it is evicted, or
+       SWAP_ERROR if its initial contents are still good. */
+    size_t swap_slot;
+
+    /* For a read-only page of an executable in memory, the frame
+       shared with other processes running it; null otherwise. */
+    struct shared_page *shared;
+    struct list_elem share_elem; /* Element in SHARED's sharers. */
+    bool pinned;                /* Pinned by share_pin()? */
+
+    /* Held while the page is being loaded, evicted or freed. */
+    struct lock lock;
+
+    struct hash_elem hash_elem; /* Element in thread's page table. */
+  };
+
+bool page_table_init (struct thread *);
+void page_table_destroy (struct thread *);
+
+bool page_add_file (struct file *, off_t, void *upage,
+                    uint32_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (struct file *, off_t, void *upage, uint32_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (const void *uaddr);
+bool page_load (const void *uaddr);
+bool page_grow_stack (const void *uaddr, const void *esp);
+bool page_evict (struct page *);
+struct frame *page_detach (void *upage);
+bool page_attach (void *upage, struct frame *);
+
+bool page_pin_range (const void *uaddr, size_t size);
+void page_unpin_range (const void *uaddr, size_t size);
+
+#endif /* vm/page.h */
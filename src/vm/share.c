@@ -0,0 +1,319 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* A frame holding one page of a read-only executable segment,
+   mapped into every process running that executable.
+
+   Entries are keyed by inode rather than by file, so that every
+   process that opens the same executable finds them.  The inode
+   pointer cannot be reused while the entry exists, because each
+   sharer keeps the executable open until it has dropped its
+   reference (see page_table_destroy()), and writes to it are
+   denied for the same period.  The key includes the number of
+   bytes read from the file, because two segments can map the same
+   file page with different amounts of it zero-filled.
+
+   The frame is clean, so it is the cheapest kind to evict: the
+   evictor unmaps it from every sharer and drops the entry, and
+   each sharer reads it in again on its next fault. */
+struct shared_page
+  {
+    struct inode *inode;        /* Executable. */
+    off_t ofs;                  /* Page's offset in INODE. */
+    uint32_t read_bytes;        /* Bytes read from INODE, rest zero. */
+    struct frame *frame;        /* Frame with the page's contents, or
+                                   null if it could not be read. */
+    struct list sharers;        /* Pages of the processes using it. */
+    int pin_cnt;                /* Number of sharers pinning it. */
+
+    /* While the first process to need the page reads it in, the
+       others wait on LOADED without holding share_lock. */
+    bool loading;               /* Still being read in? */
+    struct condition loaded;    /* Signaled when LOADING clears. */
+    struct hash_elem elem;      /* Element in shared_pages. */
+  };
+
+static struct hash shared_pages;
+static struct lock share_lock;  /* Protects shared_pages and the
+                                   members of its entries. */
+
+/* Returns a hash value for shared page S. */
+static unsigned
+shared_page_hash (const struct hash_elem *s_, void *aux UNUSED)
+{
+  const struct shared_page *s = hash_entry (s_, struct shared_page, elem);
+  return (hash_bytes (&s->inode, sizeof s->inode) ^ hash_int (s->ofs)
+          ^ hash_int (s->read_bytes));
+}
+
+/* Returns true if shared page A precedes shared page B. */
+static bool
+shared_page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct shared_page *a = hash_entry (a_, struct shared_page, elem);
+  const struct shared_page *b = hash_entry (b_, struct shared_page, elem);
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
+
+/* Initializes the shared page cache. */
+void
+share_init (void)
+{
+  hash_init (&shared_pages, shared_page_hash, shared_page_less, NULL);
+  lock_init (&share_lock);
+}
+
+/* Returns a frame holding the page of P's file at P's offset,
+   whose first READ_BYTES bytes come from the file and the rest
+   are zeros, and records P as a sharer of it in P->shared.  If
+   another process already has that page in memory, returns the
+   same frame; otherwise reads it in.  P must be locked.  The
+   frame must only be mapped read-only, and the reference must be
+   dropped with share_put().  Returns a null pointer if out of
+   memory or on a read error. */
+struct frame *
+share_get (struct page *p)
+{
+  struct shared_page key, *s;
+  struct hash_elem *e;
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+
+  key.inode = file_get_inode (p->file);
+  key.ofs = p->file_ofs;
+  key.read_bytes = p->read_bytes;
+
+  lock_acquire (&share_lock);
+  e = hash_find (&shared_pages, &key.elem);
+  if (e != NULL)
+    {
+      s = hash_entry (e, struct shared_page, elem);
+      list_push_back (&s->sharers, &p->share_elem);
+      while (s->loading)
+        cond_wait (&s->loaded, &share_lock);
+    }
+  else
+    {
+      /* Publish the entry before reading the page, so that other
+         processes faulting on it wait for this read instead of
+         starting their own, and drop the lock for the read, which
+         may also have to evict a page.  The frame stays pinned
+         until it is filled. */
+      s = malloc (sizeof *s);
+      if (s == NULL)
+        {
+          lock_release (&share_lock);
+          return NULL;
+        }
+      s->inode = key.inode;
+      s->ofs = key.ofs;
+      s->read_bytes = key.read_bytes;
+      s->frame = NULL;
+      list_init (&s->sharers);
+      list_push_back (&s->sharers, &p->share_elem);
+      s->pin_cnt = 0;
+      s->loading = true;
+      cond_init (&s->loaded);
+      hash_insert (&shared_pages, &s->elem);
+      lock_release (&share_lock);
+
+      f = frame_alloc (NULL);
+      if (f != NULL
+          && file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs)
+             != (off_t) p->read_bytes)
+        {
+          frame_free (f);
+          f = NULL;
+        }
+      if (f != NULL)
+        memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+                PGSIZE - p->read_bytes);
+
+      lock_acquire (&share_lock);
+      s->frame = f;
+      s->loading = false;
+      if (f != NULL)
+        {
+          frame_set_shared (f, s);
+          frame_unpin (f);
+        }
+      else
+        hash_delete (&shared_pages, &s->elem);
+      cond_broadcast (&s->loaded, &share_lock);
+    }
+
+  /* A failed read leaves the entry out of the table, to be freed
+     by the last process that was waiting for it. */
+  f = s->frame;
+  if (f == NULL)
+    {
+      list_remove (&p->share_elem);
+      if (list_empty (&s->sharers))
+        free (s);
+    }
+  else
+    p->shared = s;
+  lock_release (&share_lock);
+  return f;
+}
+
+/* Drops P's reference to its shared page, taken by share_get(),
+   and clears P->shared.  P must be locked and must no longer map
+   the frame.  Frees the frame when the last reference goes
+   away. */
+void
+share_put (struct page *p)
+{
+  struct shared_page *s = p->shared;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (s != NULL);
+
+  lock_acquire (&share_lock);
+  list_remove (&p->share_elem);
+  if (p->pinned)
+    {
+      p->pinned = false;
+      s->pin_cnt--;
+    }
+  p->shared = NULL;
+  if (list_empty (&s->sharers))
+    {
+      hash_delete (&shared_pages, &s->elem);
+      frame_free (s->frame);
+      free (s);
+    }
+  lock_release (&share_lock);
+}
+
+/* Prevents the frame of P's shared page from being evicted until
+   share_unpin(P).  P must be locked and mapped. */
+void
+share_pin (struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->shared != NULL);
+
+  lock_acquire (&share_lock);
+  if (!p->pinned)
+    {
+      p->pinned = true;
+      p->shared->pin_cnt++;
+    }
+  lock_release (&share_lock);
+}
+
+/* Undoes share_pin(P).  P must be locked. */
+void
+share_unpin (struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->shared != NULL);
+
+  lock_acquire (&share_lock);
+  if (p->pinned)
+    {
+      p->pinned = false;
+      p->shared->pin_cnt--;
+    }
+  lock_release (&share_lock);
+}
+
+/* Prepares to evict the frame of S, for choose_victim().  If no
+   sharer has accessed the page since the last call, and S and
+   every sharer's page can be locked without waiting, returns true
+   with share_lock and all of those page locks held, to be
+   released by share_evict().  Otherwise clears the sharers'
+   accessed bits, giving the page a second chance, and returns
+   false holding nothing. */
+bool
+share_lock_victim (struct shared_page *s)
+{
+  struct list_elem *e, *failed;
+  bool accessed = false;
+
+  if (lock_held_by_current_thread (&share_lock)
+      || !lock_try_acquire (&share_lock))
+    return false;
+  if (s->pin_cnt > 0)
+    {
+      lock_release (&share_lock);
+      return false;
+    }
+
+  for (e = list_begin (&s->sharers); e != list_end (&s->sharers);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+      uint32_t *pd = p->thread->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  if (accessed)
+    {
+      lock_release (&share_lock);
+      return false;
+    }
+
+  for (e = list_begin (&s->sharers); e != list_end (&s->sharers);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, share_elem);
+      if (lock_held_by_current_thread (&p->lock)
+          || !lock_try_acquire (&p->lock))
+        break;
+    }
+  if (e == list_end (&s->sharers))
+    return true;
+
+  /* Some sharer is busy.  Let go of what we got. */
+  failed = e;
+  for (e = list_begin (&s->sharers); e != failed; e = list_next (e))
+    lock_release (&list_entry (e, struct page, share_elem)->lock);
+  lock_release (&share_lock);
+  return false;
+}
+
+/* Evicts the frame of S, which share_lock_victim() returned true
+   for: unmaps it from every sharer, so that each reads the page in
+   again on its next fault, and frees S, but not the frame, which
+   the caller reuses.  Releases the locks share_lock_victim()
+   acquired. */
+void
+share_evict (struct shared_page *s)
+{
+  ASSERT (lock_held_by_current_thread (&share_lock));
+
+  while (!list_empty (&s->sharers))
+    {
+      struct page *p = list_entry (list_pop_front (&s->sharers),
+                                   struct page, share_elem);
+      pagedir_clear_page (p->thread->pagedir, p->upage);
+      p->frame = NULL;
+      p->shared = NULL;
+      lock_release (&p->lock);
+    }
+  hash_delete (&shared_pages, &s->elem);
+  lock_release (&share_lock);
+  free (s);
+}
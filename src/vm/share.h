@@ -0,0 +1,18 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <stdbool.h>
+
+struct frame;
+struct page;
+struct shared_page;
+
+void share_init (void);
+struct frame *share_get (struct page *);
+void share_put (struct page *);
+void share_pin (struct page *);
+void share_unpin (struct page *);
+bool share_lock_victim (struct shared_page *);
+void share_evict (struct shared_page *);
+
+#endif /* vm/share.h */